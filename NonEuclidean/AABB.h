@@ -0,0 +1,80 @@
+#pragma once
+#include "GameHeader.h"
+#include "Vector.h"
+
+class AABB {
+public:
+  AABB() : vmin(FLT_MAX), vmax(-FLT_MAX) {}
+  AABB(const Vector3& vmin, const Vector3& vmax) : vmin(vmin), vmax(vmax) {}
+
+  //Box around a center with half-extents along each axis
+  inline static AABB FromCenter(const Vector3& c, const Vector3& e) {
+    return AABB(c - e, c + e);
+  }
+
+  inline bool IsEmpty() const {
+    return vmin.x > vmax.x || vmin.y > vmax.y || vmin.z > vmax.z;
+  }
+  inline Vector3 Center() const {
+    return (vmin + vmax) * 0.5f;
+  }
+  inline Vector3 Extent() const {
+    return (vmax - vmin) * 0.5f;
+  }
+  inline float SurfaceArea() const {
+    const Vector3 d = vmax - vmin;
+    return 2.0f * (d.x*d.y + d.y*d.z + d.z*d.x);
+  }
+
+  inline void Expand(const Vector3& p) {
+    vmin.Set(GH_MIN(vmin.x, p.x), GH_MIN(vmin.y, p.y), GH_MIN(vmin.z, p.z));
+    vmax.Set(GH_MAX(vmax.x, p.x), GH_MAX(vmax.y, p.y), GH_MAX(vmax.z, p.z));
+  }
+  inline void Expand(const AABB& b) {
+    vmin.Set(GH_MIN(vmin.x, b.vmin.x), GH_MIN(vmin.y, b.vmin.y), GH_MIN(vmin.z, b.vmin.z));
+    vmax.Set(GH_MAX(vmax.x, b.vmax.x), GH_MAX(vmax.y, b.vmax.y), GH_MAX(vmax.z, b.vmax.z));
+  }
+  inline void Inflate(float r) {
+    vmin -= r;
+    vmax += r;
+  }
+
+  inline bool Intersects(const AABB& b) const {
+    return vmin.x <= b.vmax.x && vmax.x >= b.vmin.x &&
+           vmin.y <= b.vmax.y && vmax.y >= b.vmin.y &&
+           vmin.z <= b.vmax.z && vmax.z >= b.vmin.z;
+  }
+
+  //Whether the segment from a to a + delta passes through the box grown by r.
+  //Takes the reciprocal of delta so it can be shared between boxes.
+  inline bool IntersectsSegment(const Vector3& a, const Vector3& invDelta, float r) const {
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+    const float lo[3] = { vmin.x - r - a.x, vmin.y - r - a.y, vmin.z - r - a.z };
+    const float hi[3] = { vmax.x + r - a.x, vmax.y + r - a.y, vmax.z + r - a.z };
+    const float inv[3] = { invDelta.x, invDelta.y, invDelta.z };
+    for (int i = 0; i < 3; ++i) {
+      float tNear = lo[i] * inv[i];
+      float tFar = hi[i] * inv[i];
+      if (tNear > tFar) { const float tmp = tNear; tNear = tFar; tFar = tmp; }
+      //Written so a NaN from a zero delta leaves the range alone
+      if (tNear > t0) { t0 = tNear; }
+      if (tFar < t1) { t1 = tFar; }
+    }
+    return t0 <= t1;
+  }
+
+  //Bounds of this box after an affine transformation
+  AABB Transformed(const Affine3x4& m) const {
+    const Vector3 c = m.MulPoint(Center());
+    const Vector3 e = Extent();
+    const Vector3 te(
+      std::abs(m.m[0])*e.x + std::abs(m.m[1])*e.y + std::abs(m.m[2])*e.z,
+      std::abs(m.m[4])*e.x + std::abs(m.m[5])*e.y + std::abs(m.m[6])*e.z,
+      std::abs(m.m[8])*e.x + std::abs(m.m[9])*e.y + std::abs(m.m[10])*e.z);
+    return FromCenter(c, te);
+  }
+
+  Vector3 vmin;
+  Vector3 vmax;
+};
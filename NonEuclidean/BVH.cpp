@@ -0,0 +1,151 @@
+#include "BVH.h"
+#include <algorithm>
+#include <cassert>
+
+void BVH::Build(const std::vector<AABB>& boxes) {
+  Clear();
+  prims = boxes;
+  if (prims.empty()) {
+    return;
+  }
+  order.resize(prims.size());
+  primLeaf.resize(prims.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = (int)i;
+  }
+  nodes.reserve(prims.size() * 2);
+  nodes.push_back(Node());
+  nodes[0].parent = -1;
+  BuildNode(0, 0, (int)prims.size(), 0);
+}
+
+void BVH::Clear() {
+  nodes.clear();
+  prims.clear();
+  order.clear();
+  primLeaf.clear();
+}
+
+void BVH::BuildNode(int nodeIx, int start, int count, int depth) {
+  //Bounds of the prims and of their centers
+  AABB bounds;
+  AABB centers;
+  for (int i = start; i < start + count; ++i) {
+    bounds.Expand(prims[order[i]]);
+    centers.Expand(prims[order[i]].Center());
+  }
+  nodes[nodeIx].bounds = bounds;
+
+  //Small enough to be a leaf
+  if (count <= MAX_LEAF_SIZE || depth >= MAX_DEPTH - 1) {
+    nodes[nodeIx].left = -1;
+    nodes[nodeIx].start = start;
+    nodes[nodeIx].count = count;
+    for (int i = start; i < start + count; ++i) {
+      primLeaf[order[i]] = nodeIx;
+    }
+    return;
+  }
+
+  //Median split along the widest axis of the centers
+  const Vector3 d = centers.vmax - centers.vmin;
+  const int axis = (d.x > d.y && d.x > d.z ? 0 : (d.y > d.z ? 1 : 2));
+  const int mid = start + count / 2;
+  std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + start + count,
+    [&](int a, int b) {
+      const Vector3 ca = prims[a].Center();
+      const Vector3 cb = prims[b].Center();
+      return (axis == 0 ? ca.x < cb.x : (axis == 1 ? ca.y < cb.y : ca.z < cb.z));
+    });
+
+  //Children are allocated as a pair
+  const int left = (int)nodes.size();
+  nodes.push_back(Node());
+  nodes.push_back(Node());
+  nodes[nodeIx].left = left;
+  nodes[nodeIx].start = 0;
+  nodes[nodeIx].count = 0;
+  nodes[left].parent = nodeIx;
+  nodes[left + 1].parent = nodeIx;
+  BuildNode(left, start, mid - start, depth + 1);
+  BuildNode(left + 1, mid, start + count - mid, depth + 1);
+}
+
+void BVH::Update(int prim, const AABB& box) {
+  assert(prim >= 0 && prim < (int)prims.size());
+  prims[prim] = box;
+  RefitLeaf(primLeaf[prim]);
+}
+
+void BVH::RefitLeaf(int nodeIx) {
+  //Recompute the leaf from its prims
+  Node& leaf = nodes[nodeIx];
+  AABB bounds;
+  for (int i = leaf.start; i < leaf.start + leaf.count; ++i) {
+    bounds.Expand(prims[order[i]]);
+  }
+  leaf.bounds = bounds;
+
+  //Walk up the tree merging children
+  for (int ix = leaf.parent; ix >= 0; ix = nodes[ix].parent) {
+    Node& node = nodes[ix];
+    node.bounds = nodes[node.left].bounds;
+    node.bounds.Expand(nodes[node.left + 1].bounds);
+  }
+}
+
+void BVH::Query(const AABB& box, std::vector<int>& out) const {
+  out.clear();
+  if (nodes.empty()) {
+    return;
+  }
+
+  int stack[MAX_DEPTH * 2];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    const Node& node = nodes[stack[--stackSize]];
+    if (!node.bounds.Intersects(box)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (int i = node.start; i < node.start + node.count; ++i) {
+        if (prims[order[i]].Intersects(box)) {
+          out.push_back(order[i]);
+        }
+      }
+    } else {
+      stack[stackSize++] = node.left;
+      stack[stackSize++] = node.left + 1;
+    }
+  }
+}
+
+void BVH::QuerySegment(const Vector3& a, const Vector3& b, float radius, std::vector<int>& out) const {
+  out.clear();
+  if (nodes.empty()) {
+    return;
+  }
+
+  const Vector3 d = b - a;
+  const Vector3 invDelta(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+  int stack[MAX_DEPTH * 2];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    const Node& node = nodes[stack[--stackSize]];
+    if (!node.bounds.IntersectsSegment(a, invDelta, radius)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (int i = node.start; i < node.start + node.count; ++i) {
+        if (prims[order[i]].IntersectsSegment(a, invDelta, radius)) {
+          out.push_back(order[i]);
+        }
+      }
+    } else {
+      stack[stackSize++] = node.left;
+      stack[stackSize++] = node.left + 1;
+    }
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "AABB.h"
+#include <vector>
+
+//Bounding volume hierarchy over a fixed set of boxes. Boxes can be moved
+//after the build, which refits only the nodes above them.
+class BVH {
+public:
+  static const int MAX_LEAF_SIZE = 4;
+  static const int MAX_DEPTH = 64;
+
+  struct Node {
+    AABB bounds;
+    int parent;
+    int left;     // first child, right child is left + 1
+    int start;    // first index into the prim order (leaves only)
+    int count;    // number of prims, zero for inner nodes
+  };
+
+  void Build(const std::vector<AABB>& boxes);
+  void Clear();
+
+  void Update(int prim, const AABB& box);
+  void Query(const AABB& box, std::vector<int>& out) const;
+  void QuerySegment(const Vector3& a, const Vector3& b, float radius, std::vector<int>& out) const;
+
+  const AABB& Bounds(int prim) const { return prims[prim]; }
+  const std::vector<Node>& Nodes() const { return nodes; }
+  const std::vector<int>& Order() const { return order; }
+  size_t Size() const { return prims.size(); }
+
+private:
+  void BuildNode(int nodeIx, int start, int count, int depth);
+  void RefitLeaf(int nodeIx);
+
+  std::vector<Node> nodes;
+  std::vector<AABB> prims;
+  std::vector<int> order;     // prim indices grouped by leaf
+  std::vector<int> primLeaf;  // leaf node containing each prim
+};
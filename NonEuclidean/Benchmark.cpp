@@ -0,0 +1,231 @@
+#include "Benchmark.h"
+#include "ColliderBatch.h"
+#include "GameHeader.h"
+#include "Particles.h"
+#include "Timer.h"
+#include "Vector.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+  static const int BENCH_MATRICES = 256;
+  static const int BENCH_ITERS = 4000;
+  static const int BENCH_POINTS = 4096;
+  static const int BENCH_POINT_ITERS = 1000;
+  static const int BENCH_COLLIDERS = 64;
+  static const int BENCH_COLLIDER_ITERS = 20000;
+  static const int BENCH_PARTICLES = 4096;
+  static const int BENCH_PARTICLE_ITERS = 1000;
+  static const int BENCH_REPEATS = 7;
+
+  volatile float sink = 0.0f;
+
+  float Rand() {
+    return float(std::rand()) / float(RAND_MAX) * 2.0f - 1.0f;
+  }
+
+  Matrix4 RandomTRS() {
+    return Matrix4::Trans(Vector3(Rand(), Rand(), Rand()) * 10.0f) *
+      Matrix4::RotY(Rand() * 3.0f) * Matrix4::RotX(Rand() * 3.0f) * Matrix4::RotZ(Rand() * 3.0f) *
+      Matrix4::Scale(Vector3(Rand(), Rand(), Rand()) * 0.5f + 1.0f);
+  }
+
+  void Report(const char* name, float scalar, float simd, int ops) {
+    const float ns = 1e9f / float(ops);
+    std::printf("%-14s scalar %8.2f ns   simd %8.2f ns   speedup %.2fx\n",
+      name, scalar * ns, simd * ns, scalar / simd);
+  }
+
+  void ReportAffine(const char* name, float full, float affine, int ops) {
+    const float ns = 1e9f / float(ops);
+    std::printf("%-14s 4x4    %8.2f ns   3x4    %8.2f ns   speedup %.2fx\n",
+      name, full * ns, affine * ns, full / affine);
+  }
+
+  //Best of several runs to filter out scheduler noise
+  template<class F>
+  float Time(F f) {
+    Timer timer;
+    float best = FLT_MAX;
+    for (int i = 0; i < BENCH_REPEATS; ++i) {
+      timer.Start();
+      f();
+      best = GH_MIN(best, timer.Stop());
+    }
+    return best;
+  }
+}
+
+int RunBenchmarks() {
+#if GH_USE_SSE
+  std::printf("Math kernels: SSE enabled\n");
+#else
+  std::printf("Math kernels: SSE disabled, both columns run scalar code\n");
+#endif
+
+  std::srand(1);
+  std::vector<Matrix4> mats(BENCH_MATRICES);
+  for (size_t i = 0; i < mats.size(); ++i) {
+    mats[i] = RandomTRS();
+  }
+  std::vector<Vector3> points(BENCH_POINTS);
+  std::vector<Vector3> result(BENCH_POINTS);
+  for (size_t i = 0; i < points.size(); ++i) {
+    points[i] = Vector3(Rand(), Rand(), Rand());
+  }
+  const int ops = BENCH_ITERS * BENCH_MATRICES;
+  const int pointOps = BENCH_POINT_ITERS * BENCH_POINTS;
+
+  //Inverse. Matrix multiply has no SIMD kernel, it lost to the scalar code.
+  std::vector<Matrix4> out(BENCH_MATRICES);
+  float scalar = Time([&]() {
+    for (int it = 0; it < BENCH_ITERS; ++it) {
+      for (int i = 0; i < BENCH_MATRICES; ++i) { out[i] = mats[i].InverseScalar(); }
+      sink = sink + out[it % BENCH_MATRICES].m[it & 15];
+    }
+  });
+  float simd = Time([&]() {
+    for (int it = 0; it < BENCH_ITERS; ++it) {
+      for (int i = 0; i < BENCH_MATRICES; ++i) { out[i] = mats[i].Inverse(); }
+      sink = sink + out[it % BENCH_MATRICES].m[it & 15];
+    }
+  });
+  Report("Inverse", scalar, simd, ops);
+
+  //Transpose
+  scalar = Time([&]() {
+    for (int it = 0; it < BENCH_ITERS; ++it) {
+      for (int i = 0; i < BENCH_MATRICES; ++i) { out[i] = mats[i].TransposedScalar(); }
+      sink = sink + out[it % BENCH_MATRICES].m[it & 15];
+    }
+  });
+  simd = Time([&]() {
+    for (int it = 0; it < BENCH_ITERS; ++it) {
+      for (int i = 0; i < BENCH_MATRICES; ++i) { out[i] = mats[i].Transposed(); }
+      sink = sink + out[it % BENCH_MATRICES].m[it & 15];
+    }
+  });
+  Report("Transposed", scalar, simd, ops);
+
+  //Batch point and direction transforms
+  scalar = Time([&]() {
+    for (int it = 0; it < BENCH_POINT_ITERS; ++it) {
+      mats[it % BENCH_MATRICES].MulPointsScalar(points.data(), result.data(), points.size());
+      sink = sink + result[it].x;
+    }
+  });
+  simd = Time([&]() {
+    for (int it = 0; it < BENCH_POINT_ITERS; ++it) {
+      mats[it % BENCH_MATRICES].MulPoints(points.data(), result.data(), points.size());
+      sink = sink + result[it].x;
+    }
+  });
+  Report("MulPoints", scalar, simd, pointOps);
+
+  scalar = Time([&]() {
+    for (int it = 0; it < BENCH_POINT_ITERS; ++it) {
+      mats[it % BENCH_MATRICES].MulDirectionsScalar(points.data(), result.data(), points.size());
+      sink = sink + result[it].x;
+    }
+  });
+  simd = Time([&]() {
+    for (int it = 0; it < BENCH_POINT_ITERS; ++it) {
+      mats[it % BENCH_MATRICES].MulDirections(points.data(), result.data(), points.size());
+      sink = sink + result[it].x;
+    }
+  });
+  Report("MulDirections", scalar, simd, pointOps);
+
+  //Affine transforms against the full 4x4 versions
+  std::vector<Affine3x4> affines(BENCH_MATRICES);
+  std::vector<Affine3x4> affineOut(BENCH_MATRICES);
+  for (size_t i = 0; i < affines.size(); ++i) {
+    affines[i] = Affine3x4(mats[i]);
+  }
+  float full = Time([&]() {
+    for (int it = 0; it < BENCH_ITERS; ++it) {
+      const Matrix4& b = mats[it % BENCH_MATRICES];
+      for (int i = 0; i < BENCH_MATRICES; ++i) { out[i] = mats[i] * b; }
+      sink = sink + out[it % BENCH_MATRICES].m[it & 15];
+    }
+  });
+  float affine = Time([&]() {
+    for (int it = 0; it < BENCH_ITERS; ++it) {
+      const Affine3x4& b = affines[it % BENCH_MATRICES];
+      for (int i = 0; i < BENCH_MATRICES; ++i) { affineOut[i] = affines[i] * b; }
+      sink = sink + affineOut[it % BENCH_MATRICES].m[it % 12];
+    }
+  });
+  ReportAffine("Affine *", full, affine, ops);
+
+  full = Time([&]() {
+    for (int it = 0; it < BENCH_ITERS; ++it) {
+      for (int i = 0; i < BENCH_MATRICES; ++i) { out[i] = mats[i].Inverse(); }
+      sink = sink + out[it % BENCH_MATRICES].m[it & 15];
+    }
+  });
+  affine = Time([&]() {
+    for (int it = 0; it < BENCH_ITERS; ++it) {
+      for (int i = 0; i < BENCH_MATRICES; ++i) { affineOut[i] = affines[i].InverseOrthogonal(); }
+      sink = sink + affineOut[it % BENCH_MATRICES].m[it % 12];
+    }
+  });
+  ReportAffine("Affine inverse", full, affine, ops);
+
+  //Sphere against colliders, one at a time and in batches
+  std::vector<Collider> colliders;
+  for (int i = 0; i < BENCH_COLLIDERS; ++i) {
+    const Vector3 a(Rand() * 2.0f, Rand() * 2.0f, Rand() * 2.0f);
+    const Vector3 b = a + Vector3(Rand() + 1.5f, 0.0f, 0.0f);
+    const Vector3 c = b + Vector3(0.0f, Rand() + 1.5f, 0.0f);
+    colliders.push_back(Collider(a, b, c));
+  }
+  ColliderBatch batch;
+  batch.Build(colliders);
+  std::vector<uint32_t> ix(BENCH_COLLIDERS);
+  for (size_t i = 0; i < ix.size(); ++i) {
+    ix[i] = (uint32_t)i;
+  }
+  const int colliderOps = BENCH_COLLIDER_ITERS * BENCH_COLLIDERS;
+  scalar = Time([&]() {
+    for (int it = 0; it < BENCH_COLLIDER_ITERS; ++it) {
+      const Affine3x4& localToUnit = affines[it % BENCH_MATRICES];
+      for (int i = 0; i < BENCH_COLLIDERS; ++i) {
+        Vector3 push;
+        if (colliders[i].Collide(localToUnit, push)) { sink = sink + push.x; }
+      }
+    }
+  });
+  simd = Time([&]() {
+    for (int it = 0; it < BENCH_COLLIDER_ITERS; ++it) {
+      const Affine3x4& localToUnit = affines[it % BENCH_MATRICES];
+      for (int i = 0; i < BENCH_COLLIDERS; i += ColliderBatch::WIDTH) {
+        Vector3 pushes[ColliderBatch::WIDTH];
+        if (batch.Collide(localToUnit, &ix[i], ColliderBatch::WIDTH, pushes)) { sink = sink + pushes[0].x; }
+      }
+    }
+  });
+  Report("Collide", scalar, simd, colliderOps);
+
+  //Particle integration
+  Particles particles;
+  for (int i = 0; i < BENCH_PARTICLES; ++i) {
+    particles.Add(Vector3(Rand(), Rand(), Rand()), Vector3(Rand(), Rand(), Rand()), 0.1f);
+  }
+  const int particleOps = BENCH_PARTICLE_ITERS * BENCH_PARTICLES;
+  scalar = Time([&]() {
+    for (int it = 0; it < BENCH_PARTICLE_ITERS; ++it) {
+      particles.IntegrateScalar(0, BENCH_PARTICLES);
+    }
+    sink = sink + particles.Position(0).y;
+  });
+  simd = Time([&]() {
+    for (int it = 0; it < BENCH_PARTICLE_ITERS; ++it) {
+      particles.Integrate(0, BENCH_PARTICLES);
+    }
+    sink = sink + particles.Position(0).y;
+  });
+  Report("Integrate", scalar, simd, particleOps);
+  return 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+//Microbenchmarks for the engine's math kernels, prints results to stdout
+int RunBenchmarks();
@@ -0,0 +1,66 @@
+#include "Broadphase.h"
+#include "Mesh.h"
+#include "Physical.h"
+#include <algorithm>
+
+void Broadphase::Build(const PObjectVec& objs) {
+  Clear();
+  std::vector<AABB> boxes;
+  firstRef.resize(objs.size());
+  for (uint32_t i = 0; i < (uint32_t)objs.size(); ++i) {
+    const Object& obj = *objs[i];
+    firstRef[i] = (uint32_t)refs.size();
+    if (!obj.mesh || obj.AsParticles()) { continue; }
+    if (!obj.isStatic && !obj.mesh->colliders.empty()) {
+      movingObjs.push_back(i);
+    }
+    const Affine3x4& localToWorld = obj.LocalToWorld();
+    for (uint32_t c = 0; c < (uint32_t)obj.mesh->colliders.size(); ++c) {
+      ColliderRef ref;
+      ref.obj = i;
+      ref.collider = c;
+      refs.push_back(ref);
+      boxes.push_back(obj.mesh->colliders[c].Bounds(localToWorld));
+    }
+  }
+  bvh.Build(boxes);
+}
+
+void Broadphase::Refit(const PObjectVec& objs) {
+  for (size_t i = 0; i < movingObjs.size(); ++i) {
+    const uint32_t o = movingObjs[i];
+    const Object& obj = *objs[o];
+    const Physical* physical = obj.AsPhysical();
+    if (physical && physical->sleeping) { continue; }
+    const Affine3x4& localToWorld = obj.LocalToWorld();
+    for (size_t c = 0; c < obj.mesh->colliders.size(); ++c) {
+      bvh.Update(int(firstRef[o] + c), obj.mesh->colliders[c].Bounds(localToWorld));
+    }
+  }
+}
+
+void Broadphase::Clear() {
+  bvh.Clear();
+  refs.clear();
+  movingObjs.clear();
+  firstRef.clear();
+}
+
+void Broadphase::Query(const AABB& box, std::vector<ColliderRef>& out, std::vector<int>& scratch) const {
+  //Refs were created in object order, so sorted prim ids keep that order
+  bvh.Query(box, scratch);
+  std::sort(scratch.begin(), scratch.end());
+  out.resize(scratch.size());
+  for (size_t i = 0; i < scratch.size(); ++i) {
+    out[i] = refs[scratch[i]];
+  }
+}
+
+void Broadphase::QuerySegment(const Vector3& a, const Vector3& b, float radius, std::vector<ColliderRef>& out, std::vector<int>& scratch) const {
+  bvh.QuerySegment(a, b, radius, scratch);
+  std::sort(scratch.begin(), scratch.end());
+  out.resize(scratch.size());
+  for (size_t i = 0; i < scratch.size(); ++i) {
+    out[i] = refs[scratch[i]];
+  }
+}
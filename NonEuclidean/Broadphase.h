@@ -0,0 +1,31 @@
+#pragma once
+#include "BVH.h"
+#include "Object.h"
+#include <vector>
+
+//World-space collider bounds of every object in the scene. Built when a scene
+//loads, only physical objects are refit as they move.
+class Broadphase {
+public:
+  struct ColliderRef {
+    uint32_t obj;       // index into the scene's object list
+    uint32_t collider;  // index into the object's mesh colliders
+  };
+
+  void Build(const PObjectVec& objs);
+  void Refit(const PObjectVec& objs);
+  void Clear();
+
+  //Nearby colliders sorted by object then collider index. Safe to call from
+  //several threads as long as each passes its own scratch vector.
+  void Query(const AABB& box, std::vector<ColliderRef>& out, std::vector<int>& scratch) const;
+
+  //Colliders whose bounds a sphere of the given radius might touch moving from a to b
+  void QuerySegment(const Vector3& a, const Vector3& b, float radius, std::vector<ColliderRef>& out, std::vector<int>& scratch) const;
+
+private:
+  BVH bvh;
+  std::vector<ColliderRef> refs;
+  std::vector<uint32_t> movingObjs;
+  std::vector<uint32_t> firstRef;   // first ref of each object
+};
@@ -3,9 +3,23 @@
 #include <GL/glew.h>
 #include <cmath>
 
+void ScreenRect::Expand(float x, float y) {
+  minX = GH_MIN(minX, x);
+  minY = GH_MIN(minY, y);
+  maxX = GH_MAX(maxX, x);
+  maxY = GH_MAX(maxY, y);
+}
+
+ScreenRect ScreenRect::Intersect(const ScreenRect& b) const {
+  return ScreenRect(GH_MAX(minX, b.minX), GH_MAX(minY, b.minY), GH_MIN(maxX, b.maxX), GH_MIN(maxY, b.maxY));
+}
+
 Camera::Camera() :
+  scissor(ScreenRect::Full()),
   width(256),
-  height(256) {
+  height(256),
+  viewX(0),
+  viewY(0) {
   worldView.MakeIdentity();
   projection.MakeIdentity();
 }
@@ -39,7 +53,7 @@ void Camera::SetSize(int w, int h, float n, float f) {
 }
 
 void Camera::SetPositionOrientation(const Vector3& pos, float rotX, float rotY) {
-  worldView = Matrix4::RotX(rotX) * Matrix4::RotY(rotY) * Matrix4::Trans(-pos);
+  worldView = Affine3x4::RotX(rotX) * Affine3x4::RotY(rotY) * Affine3x4::Trans(-pos);
 }
 
 Matrix4 Camera::InverseProjection() const {
@@ -49,9 +63,14 @@ Matrix4 Camera::InverseProjection() const {
   const float c = projection.m[10];
   const float d = projection.m[11];
   const float e = projection.m[14];
+  //Oblique clipping only changes the third row
+  const float p = projection.m[8];
+  const float q = projection.m[9];
   invProjection.m[0] = 1.0f / a;
   invProjection.m[5] = 1.0f / b;
   invProjection.m[11] = 1.0f / e;
+  invProjection.m[12] = -p / (a * d);
+  invProjection.m[13] = -q / (b * d);
   invProjection.m[14] = 1.0f / d;
   invProjection.m[15] = -c / (d * e);
   return invProjection;
@@ -62,15 +81,27 @@ Matrix4 Camera::Matrix() const {
 }
 
 void Camera::UseViewport() const {
-  glViewport(0, 0, width, height);
+  glViewport(-viewX, -viewY, width, height);
+
+  int x0, y0, x1, y1;
+  PixelBounds(scissor, x0, y0, x1, y1);
+  glScissor(x0 - viewX, y0 - viewY, GH_MAX(x1 - x0, 0), GH_MAX(y1 - y0, 0));
+}
+
+void Camera::PixelBounds(const ScreenRect& rect, int& x0, int& y0, int& x1, int& y1) const {
+  //Round outwards so partly covered pixels still get drawn
+  x0 = (int)std::floor((rect.minX * 0.5f + 0.5f) * width);
+  y0 = (int)std::floor((rect.minY * 0.5f + 0.5f) * height);
+  x1 = (int)std::ceil((rect.maxX * 0.5f + 0.5f) * width);
+  y1 = (int)std::ceil((rect.maxY * 0.5f + 0.5f) * height);
 }
 
 void Camera::ClipOblique(const Vector3& pos, const Vector3& normal) {
-  const Vector3 cpos = (worldView * Vector4(pos, 1)).XYZ();
-  const Vector3 cnormal = (worldView * Vector4(normal, 0)).XYZ();
+  const Vector3 cpos = worldView.MulPoint(pos);
+  const Vector3 cnormal = worldView.MulDirection(normal);
   const Vector4 cplane(cnormal.x, cnormal.y, cnormal.z, -cpos.Dot(cnormal));
 
-  const Vector4 q = projection.Inverse() * Vector4(
+  const Vector4 q = InverseProjection() * Vector4(
     (cplane.x < 0.0f ? 1.0f : -1.0f),
     (cplane.y < 0.0f ? 1.0f : -1.0f),
     1.0f,
@@ -83,3 +114,35 @@ void Camera::ClipOblique(const Vector3& pos, const Vector3& normal) {
   projection.m[10] = c.z - projection.m[14];
   projection.m[11] = c.w - projection.m[15];
 }
+
+Frustum::Frustum(const Camera& cam) {
+  const Matrix4 m = cam.Matrix();
+  const Vector4 x(m.m[0], m.m[1], m.m[2], m.m[3]);
+  const Vector4 y(m.m[4], m.m[5], m.m[6], m.m[7]);
+  const Vector4 z(m.m[8], m.m[9], m.m[10], m.m[11]);
+  const Vector4 w(m.m[12], m.m[13], m.m[14], m.m[15]);
+  const ScreenRect& s = cam.scissor;
+  planes[0] = x - w * s.minX;
+  planes[1] = w * s.maxX - x;
+  planes[2] = y - w * s.minY;
+  planes[3] = w * s.maxY - y;
+  planes[4] = z + w;
+  planes[5] = w - z;
+}
+
+bool Frustum::Intersects(const AABB& box) const {
+  if (box.IsEmpty()) {
+    return false;
+  }
+  for (int i = 0; i < 6; ++i) {
+    //Corner of the box furthest along the plane normal
+    const Vector4& p = planes[i];
+    const float d = p.x * (p.x > 0.0f ? box.vmax.x : box.vmin.x) +
+                    p.y * (p.y > 0.0f ? box.vmax.y : box.vmin.y) +
+                    p.z * (p.z > 0.0f ? box.vmax.z : box.vmin.z) + p.w;
+    if (d < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -1,6 +1,22 @@
 #pragma once
+#include "AABB.h"
 #include "Vector.h"
 
+//Rectangle on screen in normalized device coordinates
+class ScreenRect {
+public:
+  ScreenRect() : minX(1.0f), minY(1.0f), maxX(-1.0f), maxY(-1.0f) {}
+  ScreenRect(float x0, float y0, float x1, float y1) : minX(x0), minY(y0), maxX(x1), maxY(y1) {}
+  static ScreenRect Full() { return ScreenRect(-1.0f, -1.0f, 1.0f, 1.0f); }
+
+  bool IsEmpty() const { return minX >= maxX || minY >= maxY; }
+  float Area() const { return IsEmpty() ? 0.0f : (maxX - minX) * (maxY - minY) * 0.25f; }
+  void Expand(float x, float y);
+  ScreenRect Intersect(const ScreenRect& b) const;
+
+  float minX, minY, maxX, maxY;
+};
+
 class Camera {
 public:
   Camera();
@@ -12,15 +28,37 @@ public:
   void SetSize(int w, int h, float n, float f);
   void SetPositionOrientation(const Vector3& pos, float rotX, float rotY);
 
+  //Sets the viewport and scissors it down to the visible rectangle
   void UseViewport() const;
 
+  //Pixels of the whole view a rectangle touches, max is exclusive
+  void PixelBounds(const ScreenRect& rect, int& x0, int& y0, int& x1, int& y1) const;
+
   void ClipOblique(const Vector3& pos, const Vector3& normal);
 
   Matrix4 projection;
-  Matrix4 worldView;
+  Affine3x4 worldView;
 
+  //Only this part of the screen can be seen, portals narrow it down further
+  ScreenRect scissor;
+
+  //Size of the whole view in pixels, the render target may only hold the
+  //part of it that starts at the view offset
   int width;
   int height;
+  int viewX;
+  int viewY;
   float near;
   float far;
 };
+
+//Clip planes of a camera, including oblique clipping and the scissor rectangle
+class Frustum {
+public:
+  explicit Frustum(const Camera& cam);
+
+  bool Intersects(const AABB& box) const;
+
+  //Points with a negative dot product are outside
+  Vector4 planes[6];
+};
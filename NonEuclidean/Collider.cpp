@@ -1,5 +1,6 @@
 #include "Collider.h"
 #include "GameHeader.h"
+#include "GLState.h"
 #include "GL/glew.h"
 #include <cassert>
 #include <iostream>
@@ -20,9 +21,9 @@ Collider::Collider(const Vector3& a, const Vector3& b, const Vector3& c) {
   }
 }
 
-bool Collider::Collide(const Matrix4& localToUnit, Vector3& delta) const {
+bool Collider::Collide(const Affine3x4& localToUnit, Vector3& delta) const {
   //Get world delta
-  const Matrix4 local = localToUnit * mat;
+  const Affine3x4 local = localToUnit * mat;
   const Vector3 v = -local.Translation();
 
   //Get axes
@@ -44,13 +45,121 @@ bool Collider::Collide(const Matrix4& localToUnit, Vector3& delta) const {
   }
 }
 
-void Collider::DebugDraw(const Camera& cam, const Matrix4& objMat) {
+AABB Collider::Bounds(const Affine3x4& localToWorld) const {
+  const Affine3x4 world = localToWorld * mat;
+  const Vector3 x = world.XAxis();
+  const Vector3 y = world.YAxis();
+  const Vector3 e(
+    std::abs(x.x) + std::abs(y.x),
+    std::abs(x.y) + std::abs(y.y),
+    std::abs(x.z) + std::abs(y.z));
+  return AABB::FromCenter(world.Translation(), e);
+}
+
+bool Collider::Cast(const Affine3x4& localToWorld, const Vector3& a, const Vector3& delta, float r, float& t, Vector3& normal) const {
+  const Affine3x4 world = localToWorld * mat;
+  const Vector3 c = world.Translation();
+  const Vector3 x = world.XAxis();
+  const Vector3 y = world.YAxis();
+  const Vector3 v = a - c;
+
+  //Already touching at the start
+  const float px = GH_CLAMP(v.Dot(x) / x.MagSq(), -1.0f, 1.0f);
+  const float py = GH_CLAMP(v.Dot(y) / y.MagSq(), -1.0f, 1.0f);
+  const Vector3 gap = v - (x*px + y*py);
+  if (r > 0.0f && gap.MagSq() < r * r) {
+    t = 0.0f;
+    normal = gap.NormalizedSafe();
+    return true;
+  }
+
+  //Face of the quad, pushed out by the radius towards the start
+  Vector3 n = x.Cross(y).Normalized();
+  float dist = v.Dot(n);
+  if (dist < 0.0f) {
+    n = -n;
+    dist = -dist;
+  }
+  const float approach = -delta.Dot(n);
+  bool hit = false;
+  t = 1.0f;
+  if (approach > 0.0f && dist >= r && dist - r <= approach) {
+    const float tFace = (dist - r) / approach;
+    const Vector3 p = v + delta * tFace;
+    if (std::abs(p.Dot(x)) <= x.MagSq() && std::abs(p.Dot(y)) <= y.MagSq()) {
+      t = tFace;
+      normal = n;
+      hit = true;
+    }
+  }
+
+  //Rounded edges and corners only exist for spheres
+  if (r > 0.0f) {
+    const Vector3 corners[4] = { c + x + y, c + x - y, c - x - y, c - x + y };
+    for (int i = 0; i < 4; ++i) {
+      float tEdge;
+      const Vector3& p = corners[i];
+      const Vector3& q = corners[(i + 1) % 4];
+      if (CastCapsule(a, delta, p, q, r, tEdge) && tEdge < t) {
+        //Normal from the closest point on the edge
+        const Vector3 s = a + delta * tEdge;
+        const Vector3 pq = q - p;
+        const float k = GH_CLAMP((s - p).Dot(pq) / pq.MagSq(), 0.0f, 1.0f);
+        t = tEdge;
+        normal = (s - (p + pq * k)).NormalizedSafe();
+        hit = true;
+      }
+    }
+  }
+  return hit;
+}
+
+bool Collider::CastCapsule(const Vector3& a, const Vector3& delta, const Vector3& p, const Vector3& q, float r, float& t) {
+  //Cylinder around the edge first, then the spheres on its ends
+  const float dd = delta.MagSq();
+  const Vector3 pq = q - p;
+  const Vector3 pa = a - p;
+  const float pqpq = pq.Dot(pq);
+  const float pqd = pq.Dot(delta);
+  const float pqpa = pq.Dot(pa);
+  const float qa = pqpq * dd - pqd * pqd;
+  const float qb = pqpq * delta.Dot(pa) - pqpa * pqd;
+  const float qc = pqpq * pa.Dot(pa) - pqpa * pqpa - r * r * pqpq;
+  bool hit = false;
+  t = FLT_MAX;
+  if (qa > 0.0f) {
+    const float h = qb * qb - qa * qc;
+    if (h >= 0.0f) {
+      const float tc = (-qb - std::sqrt(h)) / qa;
+      const float k = pqpa + tc * pqd;
+      if (tc >= 0.0f && tc <= 1.0f && k > 0.0f && k < pqpq) {
+        t = tc;
+        hit = true;
+      }
+    }
+  }
+  const Vector3 ends[2] = { pa, a - q };
+  for (int i = 0; i < 2; ++i) {
+    const float b = delta.Dot(ends[i]);
+    const float h = b * b - dd * (ends[i].Dot(ends[i]) - r * r);
+    if (b < 0.0f && h >= 0.0f) {
+      const float ts = (-b - std::sqrt(h)) / dd;
+      if (ts >= 0.0f && ts <= 1.0f && ts < t) {
+        t = ts;
+        hit = true;
+      }
+    }
+  }
+  return hit;
+}
+
+void Collider::DebugDraw(const Camera& cam, const Affine3x4& objMat) {
   glDepthFunc(GL_ALWAYS);
-  glUseProgram(0);
+  GLState::UseProgram(0);
   glBegin(GL_LINE_LOOP);
   glColor3f(0.0f, 1.0f, 0.0f);
 
-  const Matrix4 m = cam.Matrix() * objMat * mat;
+  const Matrix4 m = cam.Matrix() * (objMat * mat);
   Vector4 v;
 
   v = m * Vector4(1, 1, 0, 1);
@@ -1,17 +1,30 @@
 #pragma once
 #include "Vector.h"
 #include "Camera.h"
+#include "AABB.h"
 
 class Collider {
 public:
   Collider(const Vector3& a, const Vector3& b, const Vector3& c);
 
-  bool Collide(const Matrix4& localToWorld, Vector3& delta) const;
+  bool Collide(const Affine3x4& localToUnit, Vector3& delta) const;
+  AABB Bounds(const Affine3x4& localToWorld) const;
 
-  void DebugDraw(const Camera& cam, const Matrix4& objMat);
+  //Moves a sphere of radius r (zero for a ray) from a to a + delta in world
+  //space. On a hit, t is the fraction of delta travelled before touching the
+  //quad and normal points from the quad towards the sphere.
+  bool Cast(const Affine3x4& localToWorld, const Vector3& a, const Vector3& delta, float r, float& t, Vector3& normal) const;
+
+  void DebugDraw(const Camera& cam, const Affine3x4& objMat);
+
+  //Quad center and half-axes in mesh space
+  Vector3 Center() const { return mat.Translation(); }
+  Vector3 AxisX() const { return mat.XAxis(); }
+  Vector3 AxisY() const { return mat.YAxis(); }
 
 private:
+  static bool CastCapsule(const Vector3& a, const Vector3& delta, const Vector3& p, const Vector3& q, float r, float& t);
   void CreateSorted(const Vector3& da, const Vector3& c, const Vector3& db);
 
-  Matrix4 mat;
+  Affine3x4 mat;
 };
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "ColliderBatch.h"
+#include "GameHeader.h"
+#include <cassert>
+
+void ColliderBatch::Build(const std::vector<Collider>& colliders) {
+  const size_t n = colliders.size();
+  cx.resize(n); cy.resize(n); cz.resize(n);
+  ax.resize(n); ay.resize(n); az.resize(n);
+  bx.resize(n); by.resize(n); bz.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    const Vector3 c = colliders[i].Center();
+    const Vector3 a = colliders[i].AxisX();
+    const Vector3 b = colliders[i].AxisY();
+    cx[i] = c.x; cy[i] = c.y; cz[i] = c.z;
+    ax[i] = a.x; ay[i] = a.y; az[i] = a.z;
+    bx[i] = b.x; by[i] = b.y; bz[i] = b.z;
+  }
+}
+
+uint32_t ColliderBatch::Collide(const Affine3x4& localToUnit, const uint32_t* ix, int count, Vector3* pushes) const {
+  assert(count > 0 && count <= WIDTH);
+
+  const uint32_t laneMask = (1u << count) - 1;
+
+#if GH_USE_SSE
+  //A full run of neighbouring colliders loads straight from the arrays,
+  //anything else is gathered first with unused lanes repeating the first one
+  const float* src[9] = { cx.data(), cy.data(), cz.data(), ax.data(), ay.data(), az.data(), bx.data(), by.data(), bz.data() };
+  bool contiguous = (count == WIDTH);
+  for (int l = 1; l < count; ++l) {
+    contiguous = contiguous && (ix[l] == ix[0] + l);
+  }
+  float g[9][WIDTH];
+  const float* row[9];
+  for (int k = 0; k < 9; ++k) {
+    if (contiguous) {
+      row[k] = src[k] + ix[0];
+    } else {
+      for (int l = 0; l < WIDTH; ++l) {
+        assert(ix[l < count ? l : 0] < Size());
+        g[k][l] = src[k][ix[l < count ? l : 0]];
+      }
+      row[k] = g[k];
+    }
+  }
+  const float* m = localToUnit.m;
+  const __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2  = _mm_set1_ps(m[2]),  m3  = _mm_set1_ps(m[3]);
+  const __m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6  = _mm_set1_ps(m[6]),  m7  = _mm_set1_ps(m[7]);
+  const __m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10 = _mm_set1_ps(m[10]), m11 = _mm_set1_ps(m[11]);
+  const __m128 gcx = _mm_loadu_ps(row[0]), gcy = _mm_loadu_ps(row[1]), gcz = _mm_loadu_ps(row[2]);
+  const __m128 gax = _mm_loadu_ps(row[3]), gay = _mm_loadu_ps(row[4]), gaz = _mm_loadu_ps(row[5]);
+  const __m128 gbx = _mm_loadu_ps(row[6]), gby = _mm_loadu_ps(row[7]), gbz = _mm_loadu_ps(row[8]);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 negOne = _mm_set1_ps(-1.0f);
+  const __m128 sign = _mm_set1_ps(-0.0f);
+
+  //Sphere center relative to each collider, in unit sphere space
+  const __m128 vx = _mm_xor_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, gcx), _mm_mul_ps(m1, gcy)), _mm_mul_ps(m2, gcz)), m3), sign);
+  const __m128 vy = _mm_xor_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m4, gcx), _mm_mul_ps(m5, gcy)), _mm_mul_ps(m6, gcz)), m7), sign);
+  const __m128 vz = _mm_xor_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m8, gcx), _mm_mul_ps(m9, gcy)), _mm_mul_ps(m10, gcz)), m11), sign);
+
+  //Collider axes in unit sphere space
+  const __m128 xx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, gax), _mm_mul_ps(m1, gay)), _mm_mul_ps(m2, gaz));
+  const __m128 xy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m4, gax), _mm_mul_ps(m5, gay)), _mm_mul_ps(m6, gaz));
+  const __m128 xz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m8, gax), _mm_mul_ps(m9, gay)), _mm_mul_ps(m10, gaz));
+  const __m128 yx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, gbx), _mm_mul_ps(m1, gby)), _mm_mul_ps(m2, gbz));
+  const __m128 yy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m4, gbx), _mm_mul_ps(m5, gby)), _mm_mul_ps(m6, gbz));
+  const __m128 yz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m8, gbx), _mm_mul_ps(m9, gby)), _mm_mul_ps(m10, gbz));
+
+  //Find closest point on each quad
+  const __m128 vDotX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, xx), _mm_mul_ps(vy, xy)), _mm_mul_ps(vz, xz));
+  const __m128 vDotY = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, yx), _mm_mul_ps(vy, yy)), _mm_mul_ps(vz, yz));
+  const __m128 xMagSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xx, xx), _mm_mul_ps(xy, xy)), _mm_mul_ps(xz, xz));
+  const __m128 yMagSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(yx, yx), _mm_mul_ps(yy, yy)), _mm_mul_ps(yz, yz));
+  const __m128 px = _mm_min_ps(_mm_max_ps(_mm_div_ps(vDotX, xMagSq), negOne), one);
+  const __m128 py = _mm_min_ps(_mm_max_ps(_mm_div_ps(vDotY, yMagSq), negOne), one);
+
+  //Distance to the closest point
+  const __m128 dx = _mm_sub_ps(vx, _mm_add_ps(_mm_mul_ps(xx, px), _mm_mul_ps(yx, py)));
+  const __m128 dy = _mm_sub_ps(vy, _mm_add_ps(_mm_mul_ps(xy, px), _mm_mul_ps(yy, py)));
+  const __m128 dz = _mm_sub_ps(vz, _mm_add_ps(_mm_mul_ps(xz, px), _mm_mul_ps(yz, py)));
+  const __m128 dMagSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+  const uint32_t hits = uint32_t(_mm_movemask_ps(_mm_cmplt_ps(dMagSq, one))) & laneMask;
+  if (hits == 0) {
+    return 0;
+  }
+
+  //Push out to the surface of the sphere
+  const __m128 mag = _mm_sqrt_ps(dMagSq);
+  float outX[WIDTH], outY[WIDTH], outZ[WIDTH];
+  _mm_storeu_ps(outX, _mm_sub_ps(_mm_div_ps(dx, mag), dx));
+  _mm_storeu_ps(outY, _mm_sub_ps(_mm_div_ps(dy, mag), dy));
+  _mm_storeu_ps(outZ, _mm_sub_ps(_mm_div_ps(dz, mag), dz));
+  for (int l = 0; l < count; ++l) {
+    if (hits & (1u << l)) {
+      pushes[l].Set(outX[l], outY[l], outZ[l]);
+    }
+  }
+  return hits;
+#else
+  uint32_t hits = 0;
+  for (int l = 0; l < count; ++l) {
+    const uint32_t j = ix[l];
+    const Vector3 c(cx[j], cy[j], cz[j]);
+    const Vector3 a(ax[j], ay[j], az[j]);
+    const Vector3 b(bx[j], by[j], bz[j]);
+    const Vector3 v = -localToUnit.MulPoint(c);
+    const Vector3 x = localToUnit.MulDirection(a);
+    const Vector3 y = localToUnit.MulDirection(b);
+    const float px = GH_CLAMP(v.Dot(x) / x.MagSq(), -1.0f, 1.0f);
+    const float py = GH_CLAMP(v.Dot(y) / y.MagSq(), -1.0f, 1.0f);
+    const Vector3 delta = v - (x*px + y*py);
+    if (delta.MagSq() < 1.0f) {
+      pushes[l] = delta.Normalized() - delta;
+      hits |= (1u << l);
+    }
+  }
+  return hits & laneMask;
+#endif
+}
+
+float ColliderBatch::Sweep(const Affine3x4& localToUnit, const Vector3& start, const uint32_t* ix, int count) const {
+  static const float SKIN = 0.01f;
+  float tMin = 1.0f;
+  for (int l = 0; l < count; ++l) {
+    const uint32_t j = ix[l];
+    const Vector3 c = localToUnit.MulPoint(Vector3(cx[j], cy[j], cz[j]));
+    const Vector3 x = localToUnit.MulDirection(Vector3(ax[j], ay[j], az[j]));
+    const Vector3 y = localToUnit.MulDirection(Vector3(bx[j], by[j], bz[j]));
+    const Vector3 n = x.Cross(y).Normalized();
+
+    //Only a center that crosses the collider's plane can tunnel through it
+    float ds = (start - c).Dot(n);
+    float de = -c.Dot(n);
+    if (ds * de > 0.0f || ds == de) {
+      continue;
+    }
+
+    //The crossing has to be within a radius of the quad
+    const Vector3 d = start + (-start) * (ds / (ds - de)) - c;
+    if (std::abs(d.Dot(x)) > x.MagSq() + x.Mag() || std::abs(d.Dot(y)) > y.MagSq() + y.Mag()) {
+      continue;
+    }
+
+    //Time the sphere first gets within contact distance on the starting side
+    if (ds < 0.0f) {
+      ds = -ds;
+      de = -de;
+    }
+    const float t = GH_MAX((ds - (1.0f - SKIN)) / (ds - de), 0.0f);
+    tMin = GH_MIN(tMin, t);
+  }
+  return tMin;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "Collider.h"
+#include "Vector.h"
+#include <vector>
+
+//Structure-of-arrays copy of a mesh's colliders for testing several at once
+class ColliderBatch {
+public:
+  static const int WIDTH = 4;
+
+  void Build(const std::vector<Collider>& colliders);
+
+  //Tests a unit sphere against up to WIDTH colliders picked by index.
+  //Returns a bit mask of hits, with the push for each hit lane in pushes.
+  uint32_t Collide(const Affine3x4& localToUnit, const uint32_t* ix, int count, Vector3* pushes) const;
+
+  //Sweeps a unit sphere from start to the origin and returns the earliest time
+  //in [0, 1] it would pass through one of the colliders, or 1 if it never does.
+  //The sweep stops just inside contact distance so Collide still sees the hit.
+  float Sweep(const Affine3x4& localToUnit, const Vector3& start, const uint32_t* ix, int count) const;
+
+  size_t Size() const { return cx.size(); }
+
+private:
+  //Collider centers and half-axes
+  std::vector<float> cx, cy, cz;
+  std::vector<float> ax, ay, az;
+  std::vector<float> bx, by, bz;
+};
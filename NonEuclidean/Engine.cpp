@@ -1,39 +1,36 @@
 #include "Engine.h"
+#include "GLState.h"
 #include "Physical.h"
+#include "Particles.h"
 #include "Level1.h"
 #include "Level2.h"
 #include "Level3.h"
 #include "Level4.h"
 #include "Level5.h"
 #include "Level6.h"
-#include <GL/wglew.h>
 #include <cmath>
 #include <iostream>
 #include <algorithm>
+#include <cassert>
 
 Engine* GH_ENGINE = nullptr;
 Player* GH_PLAYER = nullptr;
 const Input* GH_INPUT = nullptr;
 int GH_REC_LEVEL = 0;
 int64_t GH_FRAME = 0;
+bool GH_HAS_GL = false;
 
-LRESULT WINAPI StaticWindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-  Engine* eng = (Engine*)GetWindowLongPtr(hWnd, GWLP_USERDATA);
-  if (eng) {
-    return eng->WindowProc(hWnd, uMsg, wParam, lParam);
-  }
-  return DefWindowProc(hWnd, uMsg, wParam, lParam);
-}
-
-Engine::Engine() : hWnd(NULL), hDC(NULL), hRC(NULL) {
+Engine::Engine(Platform* _platform, int scene) : platform(_platform), occlusionCullingSupported(0),
+  conditionalRenderSupported(false), inConditionalRender(false), renderPath(0), recursionDepth(GH_MAX_RECURSION), stencilBits(0), stencilPortals(false) {
   GH_ENGINE = this;
   GH_INPUT = &input;
-  isFullscreen = false;
+  SetThreadCount(0);
 
-  SetProcessDPIAware();
-  CreateGLWindow();
-  InitGLObjects();
-  SetupInputs();
+  isCreated = platform->Create(input);
+  GH_HAS_GL = isCreated && platform->HasGL();
+  if (GH_HAS_GL) {
+    InitGLObjects();
+  }
 
   player.reset(new Player);
   GH_PLAYER = player.get();
@@ -46,376 +43,569 @@ Engine::Engine() : hWnd(NULL), hDC(NULL), hRC(NULL) {
   vScenes.push_back(std::shared_ptr<Scene>(new Level5));
   vScenes.push_back(std::shared_ptr<Scene>(new Level6));
 
-  LoadScene(0);
+  if (scene >= 0) {
+    LoadScene(GH_MIN(scene, NumScenes() - 1));
+  }
+  SetFrameBudget(GH_FRAME_BUDGET);
 
   sky.reset(new Sky);
 }
 
-Engine::~Engine() {
-  ClipCursor(NULL);
-  wglMakeCurrent(NULL, NULL);
-  ReleaseDC(hWnd, hDC);
-  wglDeleteContext(hRC);
-  DestroyWindow(hWnd);
-}
+Engine::~Engine() {}
 
 int Engine::Run() {
-  if (!hWnd || !hDC || !hRC) {
+  if (!isCreated) {
     return 1;
   }
 
-  //Recieve events from this window
-  SetWindowLongPtr(hWnd, GWLP_USERDATA, (LONG_PTR)this);
-
   //Setup the timer
   const int64_t ticks_per_step = timer.SecondsToTicks(GH_DT);
+  const int64_t ticks_per_frame = timer.SecondsToTicks(GH_HEADLESS_DT);
   int64_t cur_ticks = timer.GetTicks();
   GH_FRAME = 0;
 
   //Game loop
-  MSG msg;
-  while (true) {
-    if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
-      //Handle windows messages
-      if (msg.message == WM_QUIT) {
-        break;
+  while (platform->PollEvents()) {
+    //Confine the cursor
+    platform->ConfineCursor();
+
+    if (input.key_press['1']) {
+      LoadScene(0);
+    } else if (input.key_press['2']) {
+      LoadScene(1);
+    } else if (input.key_press['3']) {
+      LoadScene(2);
+    } else if (input.key_press['4']) {
+      LoadScene(3);
+    } else if (input.key_press['5']) {
+      LoadScene(4);
+    } else if (input.key_press['6']) {
+      LoadScene(5);
+    } else if (input.key_press['7']) {
+      LoadScene(6);
+    }
+    if (input.key_press['P']) {
+      SetStencilPortals(!stencilPortals);
+    }
+    if (input.key_press['T']) {
+      if (Profiler::Recording()) {
+        StopTrace();
       } else {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-      }
-    } else {
-      //Confine the cursor
-      ConfineCursor();
-
-      if (input.key_press['1']) {
-        LoadScene(0);
-      } else if (input.key_press['2']) {
-        LoadScene(1);
-      } else if (input.key_press['3']) {
-        LoadScene(2);
-      } else if (input.key_press['4']) {
-        LoadScene(3);
-      } else if (input.key_press['5']) {
-        LoadScene(4);
-      } else if (input.key_press['6']) {
-        LoadScene(5);
-      } else if (input.key_press['7']) {
-        LoadScene(6);
+        StartTrace(GH_TRACE_FILE);
       }
+    }
 
-      //Used fixed time steps for updates
-      const int64_t new_ticks = timer.GetTicks();
-      for (int i = 0; cur_ticks < new_ticks && i < GH_MAX_STEPS; ++i) {
-        Update();
-        cur_ticks += ticks_per_step;
-        GH_FRAME += 1;
-        input.EndFrame();
-      }
-      cur_ticks = (cur_ticks < new_ticks ? new_ticks: cur_ticks);
+    //Used fixed time steps for updates (headless runs use a simulated clock)
+    const int64_t new_ticks = (platform->IsRealtime() ? timer.GetTicks() : cur_ticks + ticks_per_frame);
+    for (int i = 0; cur_ticks < new_ticks && i < GH_MAX_STEPS; ++i) {
+      ProfileZone zone("Update");
+      Update();
+      cur_ticks += ticks_per_step;
+      GH_FRAME += 1;
+      input.EndFrame();
+    }
+    cur_ticks = (cur_ticks < new_ticks ? new_ticks: cur_ticks);
 
-      //Setup camera for rendering
-      const float n = GH_CLAMP(NearestPortalDist() * 0.5f, GH_NEAR_MIN, GH_NEAR_MAX);
-      main_cam.worldView = player->WorldToCam();
-      main_cam.SetSize(iWidth, iHeight, n, GH_FAR);
+    //Simulation-only runs stop here
+    if (!GH_HAS_GL) {
+      continue;
+    }
+
+    //Pick how much to render from how long the last frames took. A scaled
+    //down main view is drawn offscreen and stretched over the window, stencil
+    //portals need the window's stencil buffer so they always get full size.
+    governor.BeginFrame();
+    const QualitySettings& quality = governor.Settings();
+    const int width = platform->Width();
+    const int height = platform->Height();
+    const bool scaled = (quality.viewScale < 1.0f && !stencilPortals && GLEW_VERSION_3_0);
+    recursionDepth = quality.recursion;
+
+    //Setup camera for rendering
+    const float n = GH_CLAMP(NearestPortalDist() * 0.5f, GH_NEAR_MIN, GH_NEAR_MAX);
+    main_cam.worldView = player->WorldToCam();
+    if (scaled) {
+      main_cam.SetSize(GH_MAX(int(width * quality.viewScale), 1), GH_MAX(int(height * quality.viewScale), 1), n, GH_FAR);
+    } else {
+      main_cam.SetSize(width, height, n, GH_FAR);
       main_cam.UseViewport();
+    }
 
-      //Render scene
-      GH_REC_LEVEL = GH_MAX_RECURSION;
+    //Render scene
+    ProfileZone zone("Render frame");
+    GH_REC_LEVEL = recursionDepth;
+    const int64_t drawCalls = GLState::drawCalls;
+    const int64_t stateChanges = GLState::stateChanges;
+    if (scaled) {
+      if (!viewTarget || viewTarget->Width() < width || viewTarget->Height() < height) {
+        //Same depth precision the window has, 16 bits z-fights this far out
+        viewTarget.reset(new FrameBuffer(width, height, 0, GL_DEPTH_COMPONENT24));
+      }
+      viewTarget->Render(main_cam, 0, nullptr);
+      viewTarget->Blit(main_cam.width, main_cam.height, width, height);
+    } else {
       Render(main_cam, 0, nullptr);
-      SwapBuffers(hDC);
     }
+    governor.EndFrame();
+    renderStats.frames += 1;
+    renderStats.drawCalls += GLState::drawCalls - drawCalls;
+    renderStats.stateChanges += GLState::stateChanges - stateChanges;
+    renderStats.recursion += quality.recursion;
+    renderStats.viewScale += (scaled ? quality.viewScale : 1.0f);
+    renderStats.portalScale += quality.portalScale;
+    renderStats.cpuTime += governor.CpuTime();
+    renderStats.gpuTime += governor.GpuTime();
+    zone.Next("SwapBuffers");
+    platform->SwapBuffers();
   }
 
+  if (Profiler::Recording()) {
+    StopTrace();
+  }
   DestroyGLObjects();
   return 0;
 }
 
+void Engine::StartTrace(const char* fname) {
+  traceFile = fname;
+  Profiler::Start();
+}
+
+void Engine::StopTrace() {
+  Profiler::Stop();
+  if (Profiler::WriteTrace(traceFile.c_str())) {
+    std::cout << "Wrote trace to " << traceFile << std::endl;
+  } else {
+    std::cout << "Could not write trace to " << traceFile << std::endl;
+  }
+}
+
+void Engine::SetThreadCount(int n) {
+  //Zero picks one thread per core
+  jobs.reset(new JobSystem(n > 0 ? n - 1 : -1));
+  physicsScratch.resize(jobs->NumThreads());
+}
+
 void Engine::LoadScene(int ix) {
+  ProfileZone zone("Load scene");
+
   //Clear out old scene
   if (curScene) { curScene->Unload(); }
   vObjects.clear();
   vPortals.clear();
+  ClearPortalQueries();
+  frameBuffers.ReleaseOwned();
   player->Reset();
 
   //Create new scene
   curScene = vScenes[ix];
   curScene->Load(vObjects, vPortals, *player);
+
+  //Render keeps per-portal state in fixed arrays, and portal paths only
+  //stay unique with at most GH_MAX_PORTALS portals
+  assert(vPortals.size() <= GH_MAX_PORTALS);
   vObjects.push_back(player);
+
+  //Static objects never change, so their transforms are only built once.
+  //Only the rest get updated or collide as bodies. Transforms are rebuilt
+  //lazily, building these here also means the physics threads only ever
+  //read static and portal transforms, they never write their caches.
+  dynamicObjs.clear();
+  particleSets.clear();
+  for (size_t i = 0; i < vObjects.size(); ++i) {
+    if (vObjects[i]->isStatic) {
+      vObjects[i]->LocalToWorld();
+    } else {
+      dynamicObjs.push_back((uint32_t)i);
+    }
+    if (vObjects[i]->AsParticles()) {
+      particleSets.push_back((uint32_t)i);
+    }
+  }
+  for (size_t i = 0; i < vPortals.size(); ++i) {
+    vPortals[i]->LocalToWorld();
+  }
+  broadphase.Build(vObjects);
+
+  //Objects keep their shader, texture and mesh, so the order transforms are
+  //written in is fixed
+  transformOrder.resize(vObjects.size());
+  for (size_t i = 0; i < transformOrder.size(); ++i) {
+    transformOrder[i] = (uint32_t)i;
+  }
+  std::stable_sort(transformOrder.begin(), transformOrder.end(), [this](uint32_t a, uint32_t b) {
+    const Object& oa = *vObjects[a];
+    const Object& ob = *vObjects[b];
+    if (oa.shader != ob.shader) { return oa.shader < ob.shader; }
+    if (oa.texture != ob.texture) { return oa.texture < ob.texture; }
+    return oa.mesh < ob.mesh;
+  });
+
+  //Merge static geometry so each view draws it in a few calls
+  if (GH_HAS_GL) {
+    staticGeometry.Build(vObjects, mergedObjs);
+  } else {
+    mergedObjs.assign(vObjects.size(), 0);
+  }
 }
 
 void Engine::Update() {
-  //Update
-  for (size_t i = 0; i < vObjects.size(); ++i) {
-    assert(vObjects[i].get());
-    vObjects[i]->Update();
+  //Update everything that can move and is awake
+  ProfileZone zone("Update objects");
+  bodies.clear();
+  for (size_t i = 0; i < dynamicObjs.size(); ++i) {
+    Object& obj = *vObjects[dynamicObjs[i]];
+    Physical* physical = obj.AsPhysical();
+    if (physical && physical->sleeping) {
+      continue;
+    }
+    obj.Update();
+    if (physical) {
+      bodies.push_back(dynamicObjs[i]);
+    } else {
+      obj.LocalToWorld();
+    }
   }
 
   //Collisions
-  //For each physics object
-  for (size_t i = 0; i < vObjects.size(); ++i) {
-    Physical* physical = vObjects[i]->AsPhysical();
-    if (!physical) { continue; }
-    Matrix4 worldToLocal = physical->WorldToLocal();
-
-    //For each object to collide with
-    for (size_t j = 0; j < vObjects.size(); ++j) {
-      if (i == j) { continue; }
-      Object& obj = *vObjects[j];
-      if (!obj.mesh) { continue; }
-
-      //For each hit sphere
-      for (size_t s = 0; s < physical->hitSpheres.size(); ++s) {
-        //Brings point from collider's local coordinates to hits's local coordinates.
-        const Sphere& sphere = physical->hitSpheres[s];
-        Matrix4 worldToUnit = sphere.LocalToUnit() * worldToLocal;
-        Matrix4 localToUnit = worldToUnit * obj.LocalToWorld();
-        Matrix4 unitToWorld = worldToUnit.Inverse();
-
-        //For each collider
-        for (size_t c = 0; c < obj.mesh->colliders.size(); ++c) {
-          Vector3 push;
-          const Collider& collider = obj.mesh->colliders[c];
-          if (collider.Collide(localToUnit, push)) {
-            //If push is too small, just ignore
-            push = unitToWorld.MulDirection(push);
-            vObjects[j]->OnHit(*physical, push);
-            physical->OnCollide(*vObjects[j], push);
-
-            worldToLocal = physical->WorldToLocal();
-            worldToUnit = sphere.LocalToUnit() * worldToLocal;
-            localToUnit = worldToUnit * obj.LocalToWorld();
-            unitToWorld = worldToUnit.Inverse();
-          }
-        }
-      }
+  zone.Next("Collisions");
+  broadphase.Refit(vObjects);
+
+  //Bodies that only touch static objects can't affect each other, so they are
+  //resolved in parallel. The rest follow one at a time in object order.
+  deferred.assign(bodies.size(), 0);
+  if (contacts.size() < bodies.size()) {
+    contacts.resize(bodies.size());
+  }
+  jobs->ParallelFor((int)bodies.size(), GH_PHYSICS_JOB_SIZE, [&](int begin, int end, int thread) {
+    ProfileZone job("Collide job");
+    for (int b = begin; b < end; ++b) {
+      contacts[b].clear();
+      deferred[b] = !CollidePhysical(bodies[b], physicsScratch[thread], contacts[b], true);
+    }
+  });
+  for (size_t b = 0; b < bodies.size(); ++b) {
+    if (deferred[b]) {
+      CollidePhysical(bodies[b], physicsScratch[0], contacts[b], false);
     }
   }
 
-  //Portals
-  for (size_t i = 0; i < vObjects.size(); ++i) {
-    Physical* physical = vObjects[i]->AsPhysical();
-    if (physical) {
+  //Report hits in a fixed order, no matter which thread found them
+  for (size_t b = 0; b < bodies.size(); ++b) {
+    Object& body = *vObjects[bodies[b]];
+    for (size_t c = 0; c < contacts[b].size(); ++c) {
+      vObjects[contacts[b][c].obj]->OnHit(body, contacts[b][c].push);
+    }
+  }
+
+  //Portals, then let bodies that came to rest fall asleep
+  zone.Next("Portals");
+  jobs->ParallelFor((int)bodies.size(), GH_PHYSICS_JOB_SIZE, [&](int begin, int end, int) {
+    for (int b = begin; b < end; ++b) {
+      Physical* physical = vObjects[bodies[b]]->AsPhysical();
       for (size_t j = 0; j < vPortals.size(); ++j) {
         if (physical->TryPortal(*vPortals[j])) {
           break;
         }
       }
+      physical->UpdateSleep();
+    }
+  });
+
+  //Particles collide with where everything else ended up this step
+  zone.Next("Particles");
+  for (size_t b = 0; b < bodies.size(); ++b) {
+    vObjects[bodies[b]]->LocalToWorld();
+  }
+  for (size_t p = 0; p < particleSets.size(); ++p) {
+    Particles& particles = *vObjects[particleSets[p]]->AsParticles();
+    jobs->ParallelFor(particles.Size(), GH_PARTICLE_JOB_SIZE, [&](int begin, int end, int thread) {
+      ProfileZone job("Particles job");
+      PhysicsScratch& scratch = physicsScratch[thread];
+      particles.Step(begin, end, broadphase, vObjects, vPortals, scratch.candidates, scratch.hits);
+    });
+  }
+}
+
+bool Engine::CollidePhysical(uint32_t i, PhysicsScratch& scratch, std::vector<Contact>& contacts, bool staticOnly) {
+  Physical* physical = vObjects[i]->AsPhysical();
+
+  //Only colliders near the hit spheres' path can touch them
+  std::vector<Broadphase::ColliderRef>& candidates = scratch.candidates;
+  broadphase.Query(physical->HitBounds(), candidates, scratch.hits);
+
+  //Other physical objects may be moving on another thread, unless asleep
+  if (staticOnly) {
+    for (size_t k = 0; k < candidates.size(); ++k) {
+      const Physical* other = vObjects[candidates[k].obj]->AsPhysical();
+      if (candidates[k].obj != i && other && !other->sleeping) {
+        return false;
+      }
+    }
+  }
+
+  //Don't let fast bodies pass through colliders between steps
+  SweepPhysical(i, candidates);
+  Affine3x4 worldToLocal = physical->WorldToLocal();
+
+  //For each object to collide with
+  for (size_t k = 0; k < candidates.size();) {
+    const uint32_t j = candidates[k].obj;
+    size_t kEnd = k + 1;
+    while (kEnd < candidates.size() && candidates[kEnd].obj == j) { ++kEnd; }
+    if (i == j) { k = kEnd; continue; }
+    Object& obj = *vObjects[j];
+
+    //For each hit sphere
+    for (size_t s = 0; s < physical->hitSpheres.size(); ++s) {
+      //Brings point from collider's local coordinates to hits's local coordinates.
+      const Sphere& sphere = physical->hitSpheres[s];
+      Affine3x4 worldToUnit = sphere.LocalToUnit() * worldToLocal;
+      Affine3x4 localToUnit = worldToUnit * obj.LocalToWorld();
+      Affine3x4 unitToWorld = physical->LocalToWorld() * sphere.UnitToLocal();
+
+      //Test nearby colliders in batches
+      const ColliderBatch& batch = obj.mesh->colliderBatch;
+      for (size_t c = k; c < kEnd;) {
+        uint32_t ix[ColliderBatch::WIDTH];
+        Vector3 pushes[ColliderBatch::WIDTH];
+        int count = 0;
+        for (; count < ColliderBatch::WIDTH && c + count < kEnd; ++count) {
+          ix[count] = candidates[c + count].collider;
+        }
+        const uint32_t hits = batch.Collide(localToUnit, ix, count, pushes);
+        if (hits == 0) {
+          c += count;
+          continue;
+        }
+
+        //Only the first hit is applied, later lanes are retested after the push
+        int h = 0;
+        while ((hits & (1u << h)) == 0) { ++h; }
+        c += h + 1;
+
+        //If push is too small, just ignore
+        Contact contact;
+        contact.obj = j;
+        contact.push = unitToWorld.MulDirection(pushes[h]);
+        physical->OnCollide(obj, contact.push);
+        contacts.push_back(contact);
+
+        worldToLocal = physical->WorldToLocal();
+        worldToUnit = sphere.LocalToUnit() * worldToLocal;
+        localToUnit = worldToUnit * obj.LocalToWorld();
+        unitToWorld = physical->LocalToWorld() * sphere.UnitToLocal();
+      }
+    }
+    k = kEnd;
+  }
+  return true;
+}
+
+void Engine::SweepPhysical(uint32_t i, const std::vector<Broadphase::ColliderRef>& candidates) {
+  Physical* physical = vObjects[i]->AsPhysical();
+  const Vector3 motion = physical->pos - physical->prev_pos;
+  if (motion.MagSq() == 0.0f) {
+    return;
+  }
+
+  //Colliders past a portal the body goes through this step are behind it
+  float tMax = 1.0f;
+  for (size_t p = 0; p < vPortals.size(); ++p) {
+    float t;
+    const Portal& portal = *vPortals[p];
+    const Vector3 bump = portal.GetBump(physical->prev_pos) * (2 * GH_NEAR_MIN * physical->p_scale);
+    if (portal.Intersects(physical->prev_pos, physical->pos, bump, &t)) {
+      tMax = GH_MIN(tMax, t);
+    }
+  }
+
+  //Earliest time any hit sphere reaches a collider
+  float tHit = tMax;
+  const Affine3x4& worldToLocal = physical->WorldToLocal();
+  for (size_t k = 0; k < candidates.size();) {
+    const uint32_t j = candidates[k].obj;
+    size_t kEnd = k + 1;
+    while (kEnd < candidates.size() && candidates[kEnd].obj == j) { ++kEnd; }
+    if (i == j) { k = kEnd; continue; }
+    const Object& obj = *vObjects[j];
+    const ColliderBatch& batch = obj.mesh->colliderBatch;
+
+    for (size_t s = 0; s < physical->hitSpheres.size(); ++s) {
+      const Sphere& sphere = physical->hitSpheres[s];
+      const Affine3x4 worldToUnit = sphere.LocalToUnit() * worldToLocal;
+      const Affine3x4 localToUnit = worldToUnit * obj.LocalToWorld();
+      const Vector3 start = worldToUnit.MulDirection(-motion);
+      for (size_t c = k; c < kEnd; c += ColliderBatch::WIDTH) {
+        uint32_t ix[ColliderBatch::WIDTH];
+        int count = 0;
+        for (; count < ColliderBatch::WIDTH && c + count < kEnd; ++count) {
+          ix[count] = candidates[c + count].collider;
+        }
+        tHit = GH_MIN(tHit, batch.Sweep(localToUnit, start, ix, count));
+      }
     }
+    k = kEnd;
+  }
+
+  //Back up to the first contact, the collision pass then handles the response
+  if (tHit < tMax) {
+    physical->pos = physical->prev_pos + motion * tHit;
   }
 }
 
 void Engine::Render(const Camera& cam, GLuint curFBO, const Portal* skipPortal) {
-  //Clear buffers
-  if (GH_USE_SKY) {
-    glClear(GL_DEPTH_BUFFER_BIT);
-    sky->Draw(cam);
-  } else {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  const int level = recursionDepth - GH_REC_LEVEL;
+  ProfileZone zone("Render", "level", level);
+
+  //Object transforms are written once per frame and shared by every view.
+  //Going in draw state order keeps objects with the same mesh next to each
+  //other, so a run of them is one instance range.
+  if (level == 0) {
+    size_t numTransforms = 0;
+    for (size_t i = 0; i < vObjects.size(); ++i) {
+      numTransforms += vObjects[i]->NumTransforms();
+    }
+    transforms.BeginFrame(numTransforms);
+    for (size_t i = 0; i < transformOrder.size(); ++i) {
+      vObjects[transformOrder[i]]->WriteTransforms(transforms);
+    }
+    transforms.Commit();
   }
+  transforms.UseCamera(cam);
 
-  //Create queries (if applicable)
-  GLuint queries[GH_MAX_PORTALS];
-  GLuint drawTest[GH_MAX_PORTALS];
-  assert(vPortals.size() <= GH_MAX_PORTALS);
-  if (occlusionCullingSupported) {
-    glGenQueriesARB((GLsizei)vPortals.size(), queries);
+  //Stencil portals nest inside the main framebuffer, one stencil value per level.
+  //The portal already reset the depth of its pixels, so only the top level clears.
+  if (stencilPortals) {
+    glStencilFunc(GL_EQUAL, level, 0xFF);
+  }
+  if (!stencilPortals || level == 0) {
+    glClear(GL_DEPTH_BUFFER_BIT | (GH_USE_SKY ? 0 : GL_COLOR_BUFFER_BIT) | (stencilPortals ? GL_STENCIL_BUFFER_BIT : 0));
   }
 
-  //Draw scene
+  //Draw scene, skipping anything outside of the view. Merged static objects
+  //go first, the rest are sorted by state, each level has its own queue
+  //since portals render recursively.
+  const Frustum frustum(cam);
+  staticGeometry.Draw(cam, frustum, transforms, renderStats.drawn[level], renderStats.culled[level]);
+  RenderQueue& queue = renderQueues[level];
   for (size_t i = 0; i < vObjects.size(); ++i) {
-    vObjects[i]->Draw(cam, curFBO);
+    if (!vObjects[i]->mesh || (i < mergedObjs.size() && mergedObjs[i])) {
+      continue;
+    }
+    if (!frustum.Intersects(vObjects[i]->WorldBounds())) {
+      renderStats.culled[level] += 1;
+      continue;
+    }
+    renderStats.drawn[level] += 1;
+    vObjects[i]->Enqueue(queue, cam);
   }
+  queue.Flush(transforms);
 
   //Draw portals if possible
   if (GH_REC_LEVEL > 0) {
-    //Draw portals
+    //Portals outside of the visible rectangle can be skipped without asking the GPU
+    bool onScreen[GH_MAX_PORTALS];
+    for (size_t i = 0; i < vPortals.size(); ++i) {
+      onScreen[i] = (vPortals[i].get() != skipPortal) && !vPortals[i]->ScreenBounds(cam).IsEmpty();
+    }
+
+    //Test the portals against this frame's depth. The results are read next
+    //frame, so nothing here waits on the GPU.
     GH_REC_LEVEL -= 1;
-    if (occlusionCullingSupported && GH_REC_LEVEL > 0) {
+    const bool useQueries = occlusionCullingSupported && GH_REC_LEVEL > 0;
+    PortalQuery* queries[GH_MAX_PORTALS];
+    if (useQueries) {
       glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
       glDepthMask(GL_FALSE);
       for (size_t i = 0; i < vPortals.size(); ++i) {
-        if (vPortals[i].get() != skipPortal) {
-          glBeginQueryARB(GL_SAMPLES_PASSED_ARB, queries[i]);
+        if (onScreen[i]) {
+          PortalQuery& query = GetPortalQuery(PortalPath(i));
+          if (query.pending) {
+            GLuint available = 0;
+            glGetQueryObjectuivARB(query.id, GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+            if (available) {
+              GLuint samples = 0;
+              glGetQueryObjectuivARB(query.id, GL_QUERY_RESULT_ARB, &samples);
+              query.known = true;
+              query.visible = (samples > 0);
+            }
+          }
+          glBeginQueryARB(GL_SAMPLES_PASSED_ARB, query.id);
           vPortals[i]->DrawPink(cam);
           glEndQueryARB(GL_SAMPLES_PASSED_ARB);
+          query.pending = true;
+          queries[i] = &query;
         }
       }
-      for (size_t i = 0; i < vPortals.size(); ++i) {
-        if (vPortals[i].get() != skipPortal) {
-          glGetQueryObjectuivARB(queries[i], GL_QUERY_RESULT_ARB, &drawTest[i]);
-        }
-      };
       glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
       glDepthMask(GL_TRUE);
-      glDeleteQueriesARB((GLsizei)vPortals.size(), queries);
     }
+
+    //Draw portals
     for (size_t i = 0; i < vPortals.size(); ++i) {
-      if (vPortals[i].get() != skipPortal) {
-        if (occlusionCullingSupported && (GH_REC_LEVEL > 0) && (drawTest[i] == 0)) {
-          continue;
+      if (!onScreen[i]) {
+        continue;
+      }
+
+      //Portals seen last frame are drawn right away. The rest might still be
+      //hidden, so the GPU skips them if this frame's query found no samples.
+      //Inside a portal that is already conditional everything is just drawn.
+      bool conditional = false;
+      if (useQueries && !inConditionalRender && !(queries[i]->known && queries[i]->visible)) {
+        PortalQuery& query = *queries[i];
+        if (conditionalRenderSupported) {
+          glBeginConditionalRender(query.id, GL_QUERY_WAIT);
+          conditional = inConditionalRender = true;
         } else {
-          vPortals[i]->Draw(cam, curFBO);
+          GLuint samples = 0;
+          glGetQueryObjectuivARB(query.id, GL_QUERY_RESULT_ARB, &samples);
+          query.pending = false;
+          query.known = true;
+          query.visible = (samples > 0);
+          if (!query.visible) {
+            continue;
+          }
         }
       }
-    }
-    GH_REC_LEVEL += 1;
-  }
-  
-#if 0
-  //Debug draw colliders
-  for (size_t i = 0; i < vObjects.size(); ++i) {
-    vObjects[i]->DebugDraw(cam);
-  }
-#endif
-}
 
-LRESULT Engine::WindowProc(HWND hCurWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
-  static PAINTSTRUCT ps;
-  static BYTE lpb[256];
-  static UINT dwSize = sizeof(lpb);
-
-  switch (uMsg) {
-  case WM_SYSCOMMAND:
-    if (wParam == SC_SCREENSAVE || wParam == SC_MONITORPOWER) {
-      return 0;
-    }
-    break;
-
-  case WM_PAINT:
-    BeginPaint(hCurWnd, &ps);
-    EndPaint(hCurWnd, &ps);
-    return 0;
-
-  case WM_SIZE:
-    iWidth = LOWORD(lParam);
-    iHeight = HIWORD(lParam);
-    PostMessage(hCurWnd, WM_PAINT, 0, 0);
-    return 0;
-
-  case WM_KEYDOWN:
-    //Ignore repeat keys
-    if (lParam & 0x40000000) { return 0; }
-    input.key[wParam & 0xFF] = true;
-    input.key_press[wParam & 0xFF] = true;
-    if (wParam == VK_ESCAPE) {
-      PostQuitMessage(0);
-    }
-    return 0;
+      ProfileZone portalZone("Portal", "portal", int(i));
+      const uint32_t parentPath = renderPath;
+      renderPath = PortalPath(i);
+      if (stencilPortals) {
+        vPortals[i]->DrawStencil(cam, level);
+      } else {
+        vPortals[i]->Draw(cam, curFBO);
+      }
+      renderPath = parentPath;
 
-  case WM_SYSKEYDOWN:
-    if (wParam == VK_RETURN) {
-      ToggleFullscreen();
-      return 0;
+      if (conditional) {
+        glEndConditionalRender();
+        inConditionalRender = false;
+      }
     }
-    break;
-
-  case WM_KEYUP:
-    input.key[wParam & 0xFF] = false;
-    return 0;
-
-  case WM_INPUT:
-    dwSize = sizeof(lpb);
-    GetRawInputData((HRAWINPUT)lParam, RID_INPUT, lpb, &dwSize, sizeof(RAWINPUTHEADER));
-    input.UpdateRaw((const RAWINPUT*)lpb);
-    break;
-
-  case WM_CLOSE:
-    PostQuitMessage(0);
-    return 0;
-  }
-
-  return DefWindowProc(hCurWnd, uMsg, wParam, lParam);
-}
-
-void Engine::CreateGLWindow() {
-  WNDCLASSEX wc;
-  hInstance = GetModuleHandle(NULL);
-  wc.cbSize = sizeof(WNDCLASSEX);
-  wc.style = CS_OWNDC;
-  wc.lpfnWndProc = (WNDPROC)StaticWindowProc;
-  wc.cbClsExtra = 0;
-  wc.cbWndExtra = 0;
-  wc.hInstance = hInstance;
-  wc.hIcon = LoadIcon(NULL, IDI_WINLOGO);
-  wc.hCursor = LoadCursor(NULL, IDC_ARROW);
-  wc.hbrBackground = NULL;
-  wc.lpszMenuName = NULL;
-  wc.lpszClassName = GH_CLASS;
-  wc.hIconSm = NULL;
-
-  if (!RegisterClassEx(&wc)) {
-    MessageBoxEx(NULL, "RegisterClass() failed: Cannot register window class.", "Error", MB_OK, 0);
-    return;
-  }
-
-  //Always start in windowed mode
-  iWidth = GH_SCREEN_WIDTH;
-  iHeight = GH_SCREEN_HEIGHT;
-
-  //Create the window
-  hWnd = CreateWindowEx(
-    WS_EX_APPWINDOW | WS_EX_WINDOWEDGE,
-    GH_CLASS,
-    GH_TITLE,
-    WS_OVERLAPPEDWINDOW | WS_CLIPSIBLINGS | WS_CLIPCHILDREN,
-    GH_SCREEN_X,
-    GH_SCREEN_Y,
-    iWidth,
-    iHeight,
-    NULL,
-    NULL,
-    hInstance,
-    NULL);
-
-  if (hWnd == NULL) {
-    MessageBoxEx(NULL, "CreateWindow() failed:  Cannot create a window.", "Error", MB_OK, 0);
-    return;
+    GH_REC_LEVEL += 1;
   }
 
-  hDC = GetDC(hWnd);
-
-  PIXELFORMATDESCRIPTOR pfd;
-  memset(&pfd, 0, sizeof(pfd));
-  pfd.nSize = sizeof(pfd);
-  pfd.nVersion = 1;
-  pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
-  pfd.iPixelType = PFD_TYPE_RGBA;
-  pfd.cColorBits = 32;
-  pfd.cDepthBits = 32;
-  pfd.iLayerType = PFD_MAIN_PLANE;
-
-  const int pf = ChoosePixelFormat(hDC, &pfd);
-  if (pf == 0) {
-    MessageBoxEx(NULL, "ChoosePixelFormat() failed: Cannot find a suitable pixel format.", "Error", MB_OK, 0);
-    return;
+  //Sky goes last so it only shades what nothing else covered
+  if (GH_USE_SKY) {
+    sky->Draw(cam);
   }
 
-  if (SetPixelFormat(hDC, pf, &pfd) == FALSE) {
-    MessageBoxEx(NULL, "SetPixelFormat() failed: Cannot set format specified.", "Error", MB_OK, 0);
-    return;
+  if (level == 0) {
+    transforms.EndFrame();
+    frameBuffers.ReleaseUnused();
   }
 
-  DescribePixelFormat(hDC, pf, sizeof(PIXELFORMATDESCRIPTOR), &pfd);
-
-  hRC = wglCreateContext(hDC);
-  wglMakeCurrent(hDC, hRC);
-
-  if (GH_START_FULLSCREEN) {
-    ToggleFullscreen();
-  }
-  if (GH_HIDE_MOUSE) {
-    ShowCursor(FALSE);
+#if 0
+  //Debug draw colliders
+  for (size_t i = 0; i < vObjects.size(); ++i) {
+    vObjects[i]->DebugDraw(cam);
   }
-
-  ShowWindow(hWnd, SW_SHOW);
-  SetForegroundWindow(hWnd);
-  SetFocus(hWnd);
+#endif
 }
 
 void Engine::InitGLObjects() {
-  //Initialize extensions
-  glewInit();
-
   //Basic global variables
   glClearColor(0.6f, 0.9f, 1.0f, 1.0f);
   glEnable(GL_CULL_FACE);
@@ -423,55 +613,64 @@ void Engine::InitGLObjects() {
   glEnable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS);
   glDepthMask(GL_TRUE);
+  glEnable(GL_SCISSOR_TEST);
 
   //Check GL functionality
   glGetQueryiv(GL_SAMPLES_PASSED_ARB, GL_QUERY_COUNTER_BITS_ARB, &occlusionCullingSupported);
+  conditionalRenderSupported = (GLEW_VERSION_3_0 != 0);
+  glGetIntegerv(GL_STENCIL_BITS, &stencilBits);
+}
 
-  //Attempt to enalbe vsync (if failure then oh well)
-  wglSwapIntervalEXT(1);
+void Engine::SetStencilPortals(bool enable) {
+  //Needs a stencil value for every level of recursion
+  stencilPortals = enable && GH_HAS_GL && stencilBits > 0 && (1 << stencilBits) > GH_MAX_RECURSION;
+  if (!GH_HAS_GL) {
+    return;
+  }
+  if (stencilPortals) {
+    glEnable(GL_STENCIL_TEST);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+  } else {
+    glDisable(GL_STENCIL_TEST);
+  }
 }
 
 void Engine::DestroyGLObjects() {
   curScene->Unload();
   vObjects.clear();
   vPortals.clear();
+  ClearPortalQueries();
+  if (!freeQueries.empty()) {
+    glDeleteQueriesARB((GLsizei)freeQueries.size(), freeQueries.data());
+    freeQueries.clear();
+  }
+  staticGeometry.Clear();
+  transforms.Release();
+  frameBuffers.Clear();
+  viewTarget.reset();
+  governor.Release();
+  RenderQueue::Release();
 }
 
-void Engine::SetupInputs() {
-  static const int HID_USAGE_PAGE_GENERIC     = 0x01;
-  static const int HID_USAGE_GENERIC_MOUSE    = 0x02;
-  static const int HID_USAGE_GENERIC_JOYSTICK = 0x04;
-  static const int HID_USAGE_GENERIC_GAMEPAD  = 0x05;
-
-  RAWINPUTDEVICE Rid[3];
-
-  //Mouse
-  Rid[0].usUsagePage = HID_USAGE_PAGE_GENERIC;
-  Rid[0].usUsage = HID_USAGE_GENERIC_MOUSE;
-  Rid[0].dwFlags = RIDEV_INPUTSINK;
-  Rid[0].hwndTarget = hWnd;
-
-  //Joystick
-  Rid[1].usUsagePage = HID_USAGE_PAGE_GENERIC;
-  Rid[1].usUsage = HID_USAGE_GENERIC_JOYSTICK;
-  Rid[1].dwFlags = 0;
-  Rid[1].hwndTarget = 0;
-
-  //Gamepad
-  Rid[2].usUsagePage = HID_USAGE_PAGE_GENERIC;
-  Rid[2].usUsage = HID_USAGE_GENERIC_GAMEPAD;
-  Rid[2].dwFlags = 0;
-  Rid[2].hwndTarget = 0;
-
-  RegisterRawInputDevices(Rid, 3, sizeof(Rid[0]));
+Engine::PortalQuery& Engine::GetPortalQuery(uint32_t path) {
+  PortalQuery& query = portalQueries[path];
+  if (query.id == 0) {
+    if (freeQueries.empty()) {
+      glGenQueriesARB(1, &query.id);
+    } else {
+      query.id = freeQueries.back();
+      freeQueries.pop_back();
+    }
+  }
+  return query;
 }
 
-void Engine::ConfineCursor() {
-  if (GH_HIDE_MOUSE) {
-    RECT rect;
-    GetWindowRect(hWnd, &rect);
-    SetCursorPos((rect.right + rect.left) / 2, (rect.top + rect.bottom) / 2);
+void Engine::ClearPortalQueries() {
+  //Paths belong to the old portals, but the query objects can be reused
+  for (auto it = portalQueries.begin(); it != portalQueries.end(); ++it) {
+    freeQueries.push_back(it->second.id);
   }
+  portalQueries.clear();
 }
 
 float Engine::NearestPortalDist() const {
@@ -481,22 +680,3 @@ float Engine::NearestPortalDist() const {
   }
   return dist;
 }
-
-void Engine::ToggleFullscreen() {
-  isFullscreen = !isFullscreen;
-  if (isFullscreen) {
-    iWidth = GetSystemMetrics(SM_CXSCREEN);
-    iHeight = GetSystemMetrics(SM_CYSCREEN);
-    SetWindowLong(hWnd, GWL_STYLE, WS_POPUP | WS_CLIPSIBLINGS | WS_CLIPCHILDREN);
-    SetWindowLong(hWnd, GWL_EXSTYLE, WS_EX_APPWINDOW);
-    SetWindowPos(hWnd, HWND_TOPMOST, 0, 0,
-      iWidth, iHeight, SWP_SHOWWINDOW);
-  } else {
-    iWidth = GH_SCREEN_WIDTH;
-    iHeight = GH_SCREEN_HEIGHT;
-    SetWindowLong(hWnd, GWL_STYLE, WS_OVERLAPPEDWINDOW | WS_CLIPSIBLINGS | WS_CLIPCHILDREN);
-    SetWindowLong(hWnd, GWL_EXSTYLE, WS_EX_APPWINDOW | WS_EX_WINDOWEDGE);
-    SetWindowPos(hWnd, HWND_TOP, GH_SCREEN_X, GH_SCREEN_Y,
-      iWidth, iHeight, SWP_SHOWWINDOW);
-  }
-}
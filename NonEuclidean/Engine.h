@@ -1,21 +1,57 @@
 #pragma once
 #include "GameHeader.h"
+#include "Broadphase.h"
 #include "Camera.h"
+#include "FrameBuffer.h"
 #include "Input.h"
+#include "JobSystem.h"
 #include "Object.h"
 #include "Portal.h"
+#include "Profiler.h"
+#include "Raycaster.h"
+#include "RenderQueue.h"
 #include "Player.h"
+#include "Platform.h"
+#include "QualityGovernor.h"
 #include "Timer.h"
+#include "TransformBuffer.h"
 #include "Scene.h"
 #include "Sky.h"
+#include "StaticGeometry.h"
 #include <GL/glew.h>
-#include <windows.h>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+//Object draws and frustum culls per recursion level, GL draw calls and binds
+//that changed state, portal views seen straight from the eye that were
+//rendered or reused from last frame, and the quality the governor picked
+//with the frame times it saw, summed over all frames
+struct RenderStats {
+  RenderStats() : frames(0), drawCalls(0), stateChanges(0), portalsRendered(0), portalsReused(0),
+    recursion(0), viewScale(0.0), portalScale(0.0), cpuTime(0.0), gpuTime(0.0) {
+    for (int i = 0; i <= GH_MAX_RECURSION; ++i) { drawn[i] = 0; culled[i] = 0; }
+  }
+  int64_t frames;
+  int64_t drawn[GH_MAX_RECURSION + 1];
+  int64_t culled[GH_MAX_RECURSION + 1];
+  int64_t drawCalls;
+  int64_t stateChanges;
+  int64_t portalsRendered;
+  int64_t portalsReused;
+  int64_t recursion;
+  double viewScale;
+  double portalScale;
+  double cpuTime;  // seconds
+  double gpuTime;
+};
+
 class Engine {
 public:
-  Engine();
+  //Loads the given scene, a negative one leaves it to the caller so it can
+  //set things up first. Run needs a scene either way.
+  Engine(Platform* platform, int scene = 0);
   ~Engine();
 
   int Run();
@@ -23,27 +59,73 @@ public:
   void Render(const Camera& cam, GLuint curFBO, const Portal* skipPortal);
   void LoadScene(int ix);
 
-  LRESULT WindowProc(HWND hCurWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
-
   const Player& GetPlayer() const { return *player; }
+  const RenderStats& GetRenderStats() const { return renderStats; }
+  FrameBufferPool& GetFrameBuffers() { return frameBuffers; }
+  const TransformBuffer& GetTransforms() const { return transforms; }
+  //Whether anything drawn moved or is drawn differently since last frame
+  bool SceneChanged() const { return transforms.Changed() || governor.Changed(); }
+  void CountPortalView(bool reused) { (reused ? renderStats.portalsReused : renderStats.portalsRendered) += 1; }
+  int NumScenes() const { return (int)vScenes.size(); }
   float NearestPortalDist() const;
 
+  //Casts against the current scene, each thread needs its own
+  Raycaster MakeRaycaster() const { return Raycaster(broadphase, vObjects, vPortals); }
+
+  //Threads used by the physics step, including the main thread
+  void SetThreadCount(int n);
+
+  //Frame time the governor holds rendering to, zero always renders everything
+  void SetFrameBudget(float seconds) { governor.SetBudget(seconds); }
+  const QualitySettings& Quality() const { return governor.Settings(); }
+  //Portal levels below the main view this frame
+  int RecursionDepth() const { return recursionDepth; }
+
+  //Records profiler zones until StopTrace writes them to the file. The trace
+  //hotkey and quitting while recording stop it too.
+  void StartTrace(const char* fname);
+  void StopTrace();
+
+  //Render portals with the stencil buffer instead of offscreen framebuffers.
+  //Stays off if the context has no stencil buffer.
+  void SetStencilPortals(bool enable);
+  bool StencilPortals() const { return stencilPortals; }
+
 private:
-  void CreateGLWindow();
   void InitGLObjects();
   void DestroyGLObjects();
-  void SetupInputs();
-  void ConfineCursor();
-  void ToggleFullscreen();
 
-  HDC   hDC;           // device context
-  HGLRC hRC;				   // opengl context
-  HWND  hWnd;				   // window
-  HINSTANCE hInstance; // process id
+  //Occlusion query for one portal seen along one path of portals. It stays
+  //alive between frames so its result can be read a frame late without waiting.
+  struct PortalQuery {
+    PortalQuery() : id(0), pending(false), known(false), visible(true) {}
+    GLuint id;
+    bool pending;  // issued and not read back yet
+    bool known;    // some result has come back
+    bool visible;  // the last result that came back had samples pass
+  };
+
+  PortalQuery& GetPortalQuery(uint32_t path);
+  void ClearPortalQueries();
+  uint32_t PortalPath(size_t portal) const { return renderPath * (GH_MAX_PORTALS + 1) + uint32_t(portal) + 1; }
+
+  //Per-thread scratch space for the physics step
+  struct PhysicsScratch {
+    std::vector<Broadphase::ColliderRef> candidates;
+    std::vector<int> hits;
+  };
 
-  LONG iWidth;         // window width
-  LONG iHeight;        // window height
-  bool isFullscreen;   // fullscreen state
+  //A hit reported to the object that was hit once all bodies are resolved
+  struct Contact {
+    uint32_t obj;
+    Vector3 push;
+  };
+
+  bool CollidePhysical(uint32_t i, PhysicsScratch& scratch, std::vector<Contact>& contacts, bool staticOnly);
+  void SweepPhysical(uint32_t i, const std::vector<Broadphase::ColliderRef>& candidates);
+
+  std::unique_ptr<Platform> platform;
+  bool isCreated;
 
   Camera main_cam;
   Input input;
@@ -54,7 +136,34 @@ private:
   std::shared_ptr<Sky> sky;
   std::shared_ptr<Player> player;
 
+  Broadphase broadphase;
+  std::unique_ptr<JobSystem> jobs;
+  std::vector<PhysicsScratch> physicsScratch;  // one per job thread
+  std::vector<uint32_t> dynamicObjs;           // indices of objects that can move
+  std::vector<uint32_t> bodies;                // indices of awake physical objects
+  std::vector<uint32_t> particleSets;          // indices of particle objects
+  std::vector<uint8_t> deferred;               // bodies touching other physical objects
+  std::vector<std::vector<Contact>> contacts;  // hits found by each body
+
   GLint occlusionCullingSupported;
+  bool conditionalRenderSupported;
+  bool inConditionalRender;
+  uint32_t renderPath;  // portals taken to reach the current Render call
+  std::unordered_map<uint32_t, PortalQuery> portalQueries;
+  std::vector<GLuint> freeQueries;
+  RenderStats renderStats;
+  RenderQueue renderQueues[GH_MAX_RECURSION + 1];  // one per recursion level
+  StaticGeometry staticGeometry;
+  TransformBuffer transforms;
+  std::vector<uint32_t> transformOrder;  // objects sorted by draw state
+  std::vector<uint8_t> mergedObjs;  // objects drawn by staticGeometry instead
+  FrameBufferPool frameBuffers;
+  QualityGovernor governor;
+  int recursionDepth;
+  std::unique_ptr<FrameBuffer> viewTarget;  // main view when it's scaled down
+  std::string traceFile;
+  GLint stencilBits;
+  bool stencilPortals;
 
   std::vector<std::shared_ptr<Scene>> vScenes;
   std::shared_ptr<Scene> curScene;
@@ -1,45 +1,234 @@
 #include "FrameBuffer.h"
-#include "GameHeader.h"
 #include "Engine.h"
+#include "GLState.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <iostream>
 
-FrameBuffer::FrameBuffer() {
+//Bytes per pixel of the render targets, drivers pad RGB8 out to 4
+static const size_t COLOR_BYTES = 4;
+static const size_t DEPTH_BYTES = 2;
+static const size_t DEPTH24_BYTES = 4;
+
+//Size of the whole view, and the pixels of it the target holds
+static void ViewBounds(const Camera& cam, int bounds[6]) {
+  bounds[0] = cam.width;
+  bounds[1] = cam.height;
+  cam.PixelBounds(cam.scissor, bounds[2], bounds[3], bounds[4], bounds[5]);
+}
+
+FrameBuffer::FrameBuffer(int w, int h, GLuint sharedDepth, GLenum depthFormat) : width(w), height(h), texId(0), fbo(0),
+  renderBuf(0), depthBytes(0), hasView(false) {
   glGenTextures(1, &texId);
-  glBindTexture(GL_TEXTURE_2D, texId);
+  GLState::BindTexture(GL_TEXTURE_2D, texId);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, GH_FBO_SIZE, GH_FBO_SIZE, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
   //-------------------------
-  glGenFramebuffersEXT(1, &fbo);
-  glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
-  glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, texId, 0);
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texId, 0);
   //-------------------------
-  glGenRenderbuffersEXT(1, &renderBuf);
-  glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, renderBuf);
-  glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, GL_DEPTH_COMPONENT16, GH_FBO_SIZE, GH_FBO_SIZE);
+  if (sharedDepth == 0) {
+    glGenRenderbuffers(1, &renderBuf);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderBuf);
+    glRenderbufferStorage(GL_RENDERBUFFER, depthFormat, width, height);
+    depthBytes = (depthFormat == GL_DEPTH_COMPONENT16 ? DEPTH_BYTES : DEPTH24_BYTES);
+  }
   //-------------------------
-  glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, renderBuf);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderBuf ? renderBuf : sharedDepth);
   //-------------------------
 
   //Does the GPU support current FBO configuration?
-  GLenum status = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
-  if (status != GL_FRAMEBUFFER_COMPLETE_EXT) {
-    return;
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "Incomplete portal framebuffer: " << status << std::endl;
   }
 
   //Unbind so future rendering can proceed normally
-  glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+FrameBuffer::~FrameBuffer() {
+  if (renderBuf) {
+    glDeleteRenderbuffers(1, &renderBuf);
+  }
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteTextures(1, &texId);
+  GLState::Invalidate();
+}
+
+size_t FrameBuffer::Bytes() const {
+  return size_t(width) * height * (COLOR_BYTES + depthBytes);
 }
 
 void FrameBuffer::Use() {
-  glBindTexture(GL_TEXTURE_2D, texId);
+  GLState::BindTexture(GL_TEXTURE_2D, texId);
 }
 
 void FrameBuffer::Render(const Camera& cam, GLuint curFBO, const Portal* skipPortal) {
-  glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
-  glViewport(0, 0, GH_FBO_SIZE, GH_FBO_SIZE);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  cam.UseViewport();
   GH_ENGINE->Render(cam, fbo, skipPortal);
-  glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, curFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, curFBO);
+
+  hasView = true;
+  viewMatrix = cam.Matrix();
+  ViewBounds(cam, viewBounds);
+}
+
+void FrameBuffer::Blit(int w, int h, int dstW, int dstH) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glScissor(0, 0, dstW, dstH);
+  glBlitFramebuffer(0, 0, w, h, 0, 0, dstW, dstH, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+bool FrameBuffer::Holds(const Camera& cam) const {
+  if (!hasView) {
+    return false;
+  }
+  int bounds[6];
+  ViewBounds(cam, bounds);
+  if (!std::equal(bounds, bounds + 6, viewBounds)) {
+    return false;
+  }
+
+  //The matrix includes the oblique near plane, so it covers the warp too
+  const Matrix4 m = cam.Matrix();
+  for (int i = 0; i < 16; ++i) {
+    if (std::abs(m.m[i] - viewMatrix.m[i]) > GH_PORTAL_CACHE_TOLERANCE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+FrameBufferPool::FrameBufferPool() : bytes(0), peakBytes(0) {
+  for (int i = 0; i < GH_MAX_RECURSION; ++i) {
+    depth[i] = 0;
+    depthWidth[i] = 0;
+    depthHeight[i] = 0;
+  }
+}
+
+FrameBufferPool::~FrameBufferPool() {
+  Clear();
+}
+
+//Rounds target sizes up so portals that change size a little reuse them
+static int RoundSize(int size) {
+  int rounded = 64;
+  while (rounded < size) {
+    rounded *= 2;
+  }
+  return rounded;
+}
+
+FrameBuffer& FrameBufferPool::Get(int level, int width, int height) {
+  assert(level >= 0 && level < GH_MAX_RECURSION);
+  FrameBuffer* best = nullptr;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    FrameBuffer* buffer = entries[i].buffer.get();
+    if (entries[i].level == level && !entries[i].owner && buffer->Width() >= width && buffer->Height() >= height &&
+        (!best || buffer->Bytes() < best->Bytes())) {
+      best = buffer;
+    }
+  }
+  if (best) {
+    return *best;
+  }
+
+  //Nothing fits, so replace any smaller targets on this level with a new one
+  width = RoundSize(width);
+  height = RoundSize(height);
+  for (size_t i = entries.size(); i-- > 0;) {
+    if (entries[i].level == level && !entries[i].owner &&
+        entries[i].buffer->Width() <= width && entries[i].buffer->Height() <= height) {
+      bytes -= entries[i].buffer->Bytes();
+      entries.erase(entries.begin() + i);
+    }
+  }
+  return Create(level, width, height, nullptr);
+}
+
+FrameBuffer& FrameBufferPool::GetOwned(const Portal* owner, int width, int height) {
+  //Keep the portal's target if the view still fits, otherwise start over
+  const int level = GH_MAX_RECURSION - 1;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    if (entries[i].owner == owner) {
+      FrameBuffer* buffer = entries[i].buffer.get();
+      if (buffer->Width() >= width && buffer->Height() >= height) {
+        entries[i].used = true;
+        return *buffer;
+      }
+      bytes -= buffer->Bytes();
+      entries.erase(entries.begin() + i);
+      break;
+    }
+  }
+  return Create(level, RoundSize(width), RoundSize(height), owner);
+}
+
+void FrameBufferPool::ReleaseUnused() {
+  for (size_t i = entries.size(); i-- > 0;) {
+    if (entries[i].owner && !entries[i].used) {
+      bytes -= entries[i].buffer->Bytes();
+      entries.erase(entries.begin() + i);
+    } else {
+      entries[i].used = false;
+    }
+  }
+}
+
+void FrameBufferPool::ReleaseOwned() {
+  for (size_t i = entries.size(); i-- > 0;) {
+    if (entries[i].owner) {
+      bytes -= entries[i].buffer->Bytes();
+      entries.erase(entries.begin() + i);
+    }
+  }
+}
+
+FrameBuffer& FrameBufferPool::Create(int level, int width, int height, const Portal* owner) {
+  //Grow the level's depth buffer to fit, targets already attached to it follow
+  if (GLEW_VERSION_3_0 && (width > depthWidth[level] || height > depthHeight[level])) {
+    if (depth[level] == 0) {
+      glGenRenderbuffers(1, &depth[level]);
+    }
+    const int w = GH_MAX(width, depthWidth[level]);
+    const int h = GH_MAX(height, depthHeight[level]);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth[level]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, w, h);
+    bytes += (size_t(w) * h - size_t(depthWidth[level]) * depthHeight[level]) * DEPTH_BYTES;
+    depthWidth[level] = w;
+    depthHeight[level] = h;
+  }
+
+  Entry entry;
+  entry.level = level;
+  entry.owner = owner;
+  entry.used = true;
+  entry.buffer.reset(new FrameBuffer(width, height, depth[level]));
+  bytes += entry.buffer->Bytes();
+  peakBytes = GH_MAX(peakBytes, bytes);
+  entries.push_back(std::move(entry));
+  return *entries.back().buffer;
+}
+
+void FrameBufferPool::Clear() {
+  entries.clear();
+  for (int i = 0; i < GH_MAX_RECURSION; ++i) {
+    if (depth[i]) {
+      glDeleteRenderbuffers(1, &depth[i]);
+    }
+    depth[i] = 0;
+    depthWidth[i] = 0;
+    depthHeight[i] = 0;
+  }
+  bytes = 0;
 }
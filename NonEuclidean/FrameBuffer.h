@@ -1,19 +1,91 @@
 #pragma once
 #include "Camera.h"
+#include "GameHeader.h"
 #include <GL/glew.h>
+#include <memory>
+#include <vector>
 
 //Forward declaration
 class Portal;
 
 class FrameBuffer {
 public:
-  FrameBuffer();
+  //Uses the given depth buffer if there is one, otherwise makes its own in
+  //the given format
+  FrameBuffer(int width, int height, GLuint sharedDepth, GLenum depthFormat = GL_DEPTH_COMPONENT16);
+  ~FrameBuffer();
 
   void Render(const Camera& cam, GLuint curFBO, const Portal* skipPortal);
   void Use();
+  //Stretches the bottom left w by h pixels over dstW by dstH of the screen
+  void Blit(int w, int h, int dstW, int dstH);
+
+  //Whether the last Render was from this camera, looking at the same pixels
+  bool Holds(const Camera& cam) const;
+
+  int Width() const { return width; }
+  int Height() const { return height; }
+  size_t Bytes() const;
 
 private:
+  FrameBuffer(const FrameBuffer&) = delete;
+  FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+  int width;
+  int height;
   GLuint texId;
   GLuint fbo;
-  GLuint renderBuf;
+  GLuint renderBuf;  // only set when the depth buffer isn't shared
+  size_t depthBytes; // per pixel of renderBuf
+
+  //What the last Render drew, effective camera matrix and pixel bounds
+  bool hasView;
+  Matrix4 viewMatrix;
+  int viewBounds[6];
+};
+
+//Portal render targets shared by all portals. Only one portal per recursion
+//level is being rendered at a time, so each level only needs targets big
+//enough for the portals on it. Targets are made on first use and survive
+//scene changes, except the ones owned by a portal.
+class FrameBufferPool {
+public:
+  FrameBufferPool();
+  ~FrameBufferPool();
+
+  //Smallest render target at least width by height for portals that are
+  //the given number of levels from the bottom
+  FrameBuffer& Get(int level, int width, int height);
+  //Target only the given portal renders into, so the view it holds survives
+  //until the next frame. For portals seen straight from the eye.
+  FrameBuffer& GetOwned(const Portal* owner, int width, int height);
+  //Drops owned targets nobody asked for since the last call, once per frame
+  void ReleaseUnused();
+  //Owned targets belong to the scene's portals, drop them all on scene change
+  void ReleaseOwned();
+  void Clear();
+
+  //Video memory held by the targets, now and at most
+  size_t Bytes() const { return bytes; }
+  size_t PeakBytes() const { return peakBytes; }
+
+private:
+  struct Entry {
+    int level;
+    const Portal* owner;  // shared by the level's portals if null
+    bool used;
+    std::unique_ptr<FrameBuffer> buffer;
+  };
+
+  FrameBuffer& Create(int level, int width, int height, const Portal* owner);
+
+  std::vector<Entry> entries;
+
+  //Targets on the same level take turns, so they can share one depth buffer
+  //as large as the biggest of them. Needs GL 3.0 to mix attachment sizes.
+  GLuint depth[GH_MAX_RECURSION];
+  int depthWidth[GH_MAX_RECURSION];
+  int depthHeight[GH_MAX_RECURSION];
+  size_t bytes;
+  size_t peakBytes;
 };
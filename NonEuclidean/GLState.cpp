@@ -0,0 +1,58 @@
+#include "GLState.h"
+
+//Never a real name, so the first bind always goes through
+static const GLuint UNKNOWN = ~GLuint(0);
+
+int64_t GLState::drawCalls = 0;
+int64_t GLState::stateChanges = 0;
+GLuint GLState::program = UNKNOWN;
+GLuint GLState::texture2D = UNKNOWN;
+GLuint GLState::textureArray = UNKNOWN;
+GLuint GLState::vao = UNKNOWN;
+
+void GLState::UseProgram(GLuint _program) {
+  if (program != _program) {
+    glUseProgram(_program);
+    program = _program;
+    stateChanges += 1;
+  }
+}
+
+void GLState::BindTexture(GLenum target, GLuint texture) {
+  GLuint* bound = (target == GL_TEXTURE_2D ? &texture2D : target == GL_TEXTURE_2D_ARRAY ? &textureArray : nullptr);
+  if (!bound || *bound != texture) {
+    glBindTexture(target, texture);
+    if (bound) { *bound = texture; }
+    stateChanges += 1;
+  }
+}
+
+void GLState::BindVertexArray(GLuint _vao) {
+  if (vao != _vao) {
+    glBindVertexArray(_vao);
+    vao = _vao;
+    stateChanges += 1;
+  }
+}
+
+void GLState::DrawElements(GLenum mode, GLsizei count, GLenum type) {
+  glDrawElements(mode, count, type, nullptr);
+  drawCalls += 1;
+}
+
+void GLState::DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, GLsizei instances) {
+  glDrawElementsInstanced(mode, count, type, nullptr, instances);
+  drawCalls += 1;
+}
+
+void GLState::MultiDrawElementsIndirect(GLenum mode, GLenum type, size_t offset, GLsizei draws) {
+  glMultiDrawElementsIndirect(mode, type, (const GLvoid*)offset, draws, 0);
+  drawCalls += 1;
+}
+
+void GLState::Invalidate() {
+  program = UNKNOWN;
+  texture2D = UNKNOWN;
+  textureArray = UNKNOWN;
+  vao = UNKNOWN;
+}
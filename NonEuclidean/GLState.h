@@ -0,0 +1,38 @@
+#pragma once
+#include <GL/glew.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Same layout as GL's DrawElementsIndirectCommand
+struct DrawElementsCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+//Remembers what is bound so binding the same thing again costs nothing.
+//Programs, textures and vertex arrays should only be bound through here.
+class GLState {
+public:
+  static void UseProgram(GLuint program);
+  static void BindTexture(GLenum target, GLuint texture);
+  static void BindVertexArray(GLuint vao);
+  static void DrawElements(GLenum mode, GLsizei count, GLenum type);
+  static void DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, GLsizei instances);
+  static void MultiDrawElementsIndirect(GLenum mode, GLenum type, size_t offset, GLsizei draws);
+
+  //Deleted names can be handed out again, so forget everything
+  static void Invalidate();
+
+  //Totals since startup
+  static int64_t drawCalls;
+  static int64_t stateChanges;
+
+private:
+  static GLuint program;
+  static GLuint texture2D;
+  static GLuint textureArray;
+  static GLuint vao;
+};
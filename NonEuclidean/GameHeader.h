@@ -1,7 +1,10 @@
 #pragma once
 #include <stdint.h>
+#include <cmath>
+#ifdef _MSC_VER
 #pragma warning(disable : 4100) // Unreferenced formal parameter
 #pragma warning(disable : 4099) // Missing PDB file
+#endif
 
 //Windows
 static const char GH_TITLE[] = "NonEuclideanDemo";
@@ -10,6 +13,8 @@ static const char GH_CLASS[] = "NED";
 //General
 static const float GH_PI = 3.141592653589793f;
 static const int GH_MAX_PORTALS = 16;
+static const int GH_PROFILE_EVENTS = 65536;
+static const char GH_TRACE_FILE[] = "trace.json";
 
 //Graphics
 static const bool GH_START_FULLSCREEN = false;
@@ -24,7 +29,16 @@ static const float GH_NEAR_MIN = 1e-3f;
 static const float GH_NEAR_MAX = 1e-1f;
 static const float GH_FAR = 100.0f;
 static const int GH_FBO_SIZE = 2048;
+static const float GH_FBO_FALLOFF = 0.7f;
 static const int GH_MAX_RECURSION = 4;
+static const int GH_FRAMES_IN_FLIGHT = 3;
+static const float GH_PORTAL_CACHE_TOLERANCE = 1e-5f;
+static const float GH_FRAME_BUDGET = 1.0f / 60.0f;
+static const float GH_BUDGET_HEADROOM = 0.7f;
+static const float GH_BUDGET_SMOOTH = 0.2f;
+static const int GH_BUDGET_SETTLE = 20;
+static const float GH_BUDGET_GAIN = 0.95f;
+static const int GH_BUDGET_RETRY = 600;
 
 //Gameplay
 static const float GH_MOUSE_SENSITIVITY = 0.005f;
@@ -35,11 +49,17 @@ static const float GH_BOB_FREQ = 8.0f;
 static const float GH_BOB_OFFS = 0.015f;
 static const float GH_BOB_DAMP = 0.04f;
 static const float GH_BOB_MIN = 0.1f;
-static const float GH_DT = 0.002f;
-static const int GH_MAX_STEPS = 30;
+static const float GH_DT = 1.0f / 120.0f;
+static const float GH_TUNED_DT = 0.002f;
+static const int GH_MAX_STEPS = 8;
+static const int GH_PHYSICS_JOB_SIZE = 16;
+static const int GH_PARTICLE_JOB_SIZE = 256;
+static const float GH_HEADLESS_DT = 1.0f / 60.0f;
 static const float GH_PLAYER_HEIGHT = 1.5f;
 static const float GH_PLAYER_RADIUS = 0.2f;
 static const float GH_GRAVITY = -9.8f;
+static const float GH_SLEEP_SPEED = 0.3f;
+static const float GH_SLEEP_TIME = 0.5f;
 
 //Global variables
 class Engine;
@@ -50,6 +70,7 @@ extern Player* GH_PLAYER;
 extern const Input* GH_INPUT;
 extern int GH_REC_LEVEL;
 extern int64_t GH_FRAME;
+extern bool GH_HAS_GL;
 
 //Functions
 template<class T>
@@ -64,3 +85,9 @@ template<class T>
 inline T GH_MAX(T a, T b) {
   return a > b ? a : b;
 }
+
+//Drag, friction and damping coefficients were tuned per GH_TUNED_DT step,
+//this gives the same decay over one GH_DT step
+inline float GH_STEP_DECAY(float coef) {
+  return 1.0f - std::pow(1.0f - coef, GH_DT / GH_TUNED_DT);
+}
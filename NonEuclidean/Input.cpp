@@ -1,7 +1,9 @@
 #include "Input.h"
 #include "GameHeader.h"
+#ifdef _WIN32
 #include <Windows.h>
-#include <memory>
+#endif
+#include <cstring>
 
 Input::Input() {
   memset(this, 0, sizeof(Input));
@@ -16,6 +18,7 @@ void Input::EndFrame() {
   mouse_ddy = 0.0f;
 }
 
+#ifdef _WIN32
 void Input::UpdateRaw(const tagRAWINPUT* raw) {
   static BYTE buffer[2048];
   static UINT buffer_size = sizeof(buffer);
@@ -44,3 +47,4 @@ void Input::UpdateRaw(const tagRAWINPUT* raw) {
     //TODO:
   }
 }
+#endif
@@ -0,0 +1,114 @@
+#include "JobSystem.h"
+
+JobSystem::JobSystem(int numWorkers) : queued(0), remaining(0), quit(false) {
+  if (numWorkers < 0) {
+    const int hw = int(std::thread::hardware_concurrency());
+    numWorkers = (hw > 1 ? hw - 1 : 0);
+  }
+  for (int i = 0; i <= numWorkers; ++i) {
+    queues.push_back(std::unique_ptr<Queue>(new Queue));
+  }
+  for (int i = 0; i < numWorkers; ++i) {
+    workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i + 1));
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    quit = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+}
+
+void JobSystem::ParallelFor(int count, int grain, const RangeFn& fn) {
+  if (count <= 0) {
+    return;
+  }
+
+  //Not worth waking anyone up for a single job
+  grain = (grain < 1 ? 1 : grain);
+  if (workers.empty() || count <= grain) {
+    fn(0, count, 0);
+    return;
+  }
+
+  //Deal jobs round-robin so every thread starts with its own share
+  const int numJobs = (count + grain - 1) / grain;
+  remaining = numJobs;
+  for (int j = 0; j < numJobs; ++j) {
+    Job job;
+    job.fn = &fn;
+    job.begin = j * grain;
+    job.end = (job.begin + grain < count ? job.begin + grain : count);
+    Queue& queue = *queues[j % queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(job);
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    queued += numJobs;
+  }
+  wake.notify_all();
+
+  //Help out until every job has finished
+  Job job;
+  while (remaining > 0) {
+    if (Pop(0, job)) {
+      Execute(job, 0);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+bool JobSystem::Pop(int thread, Job& job) {
+  //Own queue first, oldest job first
+  const int n = int(queues.size());
+  {
+    Queue& queue = *queues[thread];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      job = queue.jobs.front();
+      queue.jobs.pop_front();
+      queued -= 1;
+      return true;
+    }
+  }
+
+  //Steal the newest job from someone else
+  for (int i = 1; i < n; ++i) {
+    Queue& queue = *queues[(thread + i) % n];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty()) {
+      job = queue.jobs.back();
+      queue.jobs.pop_back();
+      queued -= 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+void JobSystem::Execute(const Job& job, int thread) {
+  (*job.fn)(job.begin, job.end, thread);
+  remaining -= 1;
+}
+
+void JobSystem::WorkerLoop(int thread) {
+  Job job;
+  while (true) {
+    if (Pop(thread, job)) {
+      Execute(job, thread);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wake.wait(lock, [this]() { return quit || queued > 0; });
+    if (quit) {
+      return;
+    }
+  }
+}
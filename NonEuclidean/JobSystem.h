@@ -0,0 +1,52 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Work-stealing thread pool. Each thread owns a queue of jobs and takes from
+//its front, idle threads steal from the back of the other queues.
+class JobSystem {
+public:
+  //Called with a range [begin, end) and the index of the thread running it
+  typedef std::function<void(int begin, int end, int thread)> RangeFn;
+
+  //Negative worker counts use one worker per extra hardware thread
+  explicit JobSystem(int numWorkers = -1);
+  ~JobSystem();
+
+  //Splits [0, count) into jobs of at most grain items and blocks until all
+  //of them ran. The calling thread helps out as thread 0. Not reentrant.
+  void ParallelFor(int count, int grain, const RangeFn& fn);
+
+  //Workers plus the calling thread
+  int NumThreads() const { return int(workers.size()) + 1; }
+
+private:
+  struct Job {
+    const RangeFn* fn;
+    int begin;
+    int end;
+  };
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  bool Pop(int thread, Job& job);
+  void Execute(const Job& job, int thread);
+  void WorkerLoop(int thread);
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<Queue>> queues;
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  std::atomic<int> queued;
+  std::atomic<int> remaining;
+  bool quit;
+};
@@ -1,6 +1,16 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "Engine.h"
+#include "Benchmark.h"
+#include "Mesh.h"
+#include "PlatformHeadless.h"
+#ifdef _WIN32
+#include "PlatformWin32.h"
+#endif
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
+#ifdef _WIN32
 int APIENTRY WinMain(HINSTANCE hCurrentInst, HINSTANCE hPreviousInst, LPSTR lpszCmdLine, int nCmdShow) {
   //Open console in debug mode
 #ifdef _DEBUG
@@ -11,6 +21,73 @@ int APIENTRY WinMain(HINSTANCE hCurrentInst, HINSTANCE hPreviousInst, LPSTR lpsz
 #endif
 
   //Run the main engine
-  Engine engine;
+  Engine engine(new PlatformWin32);
   return engine.Run();
 }
+#else
+int main(int argc, char* argv[]) {
+  //Headless options: -frames N, -scene N, -threads N, -gl, -stencil, -budget MS, -trace FILE, -bench
+  int64_t numFrames = 600;
+  int scene = 0;
+  int threads = 0;
+  bool useGL = false;
+  bool useStencil = false;
+  float budget = 0.0f;
+  const char* trace = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+      numFrames = std::atoll(argv[++i]);
+    } else if (std::strcmp(argv[i], "-scene") == 0 && i + 1 < argc) {
+      scene = std::atoi(argv[++i]) - 1;
+    } else if (std::strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+      threads = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "-gl") == 0) {
+      useGL = true;
+    } else if (std::strcmp(argv[i], "-stencil") == 0) {
+      useStencil = true;
+    } else if (std::strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+      budget = float(std::atof(argv[++i]));
+    } else if (std::strcmp(argv[i], "-trace") == 0 && i + 1 < argc) {
+      trace = argv[++i];
+    } else if (std::strcmp(argv[i], "-bench") == 0) {
+      return RunBenchmarks();
+    }
+  }
+
+  //Run the main engine without a window
+  //The scene is loaded once everything is set up, so traces include it
+  Engine engine(new PlatformHeadless(numFrames, useGL), -1);
+  engine.SetThreadCount(threads);
+  engine.SetStencilPortals(useStencil);
+  engine.SetFrameBudget(budget * 0.001f);
+  if (trace) {
+    engine.StartTrace(trace);
+  }
+  engine.LoadScene(GH_CLAMP(scene, 0, engine.NumScenes() - 1));
+  const int result = engine.Run();
+
+  //Report how much frustum culling saved
+  const RenderStats& stats = engine.GetRenderStats();
+  for (int i = 0; i <= GH_MAX_RECURSION && stats.frames > 0; ++i) {
+    std::printf("Recursion %d: %.1f draws, %.1f culled per frame\n", i,
+      double(stats.drawn[i]) / stats.frames, double(stats.culled[i]) / stats.frames);
+  }
+  if (stats.frames > 0) {
+    const Mesh::UploadStats& meshStats = Mesh::Stats();
+    std::printf("Meshes: %lld -> %lld vertices, %.1f -> %.1f KB, %.2f -> %.2f cache misses per triangle\n",
+      (long long)meshStats.faceVerts, (long long)meshStats.uniqueVerts,
+      meshStats.arrayBytes / 1024.0, meshStats.indexedBytes / 1024.0,
+      double(meshStats.missesBefore) / GH_MAX(meshStats.triangles, int64_t(1)),
+      double(meshStats.missesAfter) / GH_MAX(meshStats.triangles, int64_t(1)));
+    std::printf("%.1f draw calls, %.1f state changes per frame\n",
+      double(stats.drawCalls) / stats.frames, double(stats.stateChanges) / stats.frames);
+    std::printf("Portal framebuffers: %.1f MB at most\n", double(engine.GetFrameBuffers().PeakBytes()) / (1024 * 1024));
+    std::printf("Portal views: %.1f rendered, %.1f reused per frame\n",
+      double(stats.portalsRendered) / stats.frames, double(stats.portalsReused) / stats.frames);
+    std::printf("Quality: %.2f recursion, %.2f view scale, %.2f portal scale, %.2f ms CPU, %.2f ms GPU per frame\n",
+      double(stats.recursion) / stats.frames, stats.viewScale / stats.frames, stats.portalScale / stats.frames,
+      stats.cpuTime * 1000.0 / stats.frames, stats.gpuTime * 1000.0 / stats.frames);
+  }
+  return result;
+}
+#endif
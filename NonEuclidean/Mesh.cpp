@@ -1,11 +1,19 @@
 #include "Mesh.h"
+#include "GameHeader.h"
+#include "GLState.h"
+#include "Profiler.h"
 #include "Vector.h"
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <cassert>
+#include <cstring>
+
+Mesh::UploadStats Mesh::stats = {};
+
+Mesh::Mesh(const char* fname) : vao(0), vbo(0), ibo(0), numVertices(0), numIndices(0), indexType(GL_UNSIGNED_SHORT), uvSize(2), hasInstanceAttribs(false) {
+  ProfileZone zone("Load mesh");
 
-Mesh::Mesh(const char* fname) {
   //Open the file for reading
   std::ifstream fin(std::string("Meshes/") + fname);
   if (!fin) {
@@ -15,6 +23,7 @@ Mesh::Mesh(const char* fname) {
   //Temporaries
   std::vector<float> vert_palette;
   std::vector<float> uv_palette;
+  std::vector<float> corners;
   bool is3DTex = false;
 
   //Read the file
@@ -120,49 +129,120 @@ Mesh::Mesh(const char* fname) {
       }
 
       //Add face to list
-      AddFace(vert_palette, uv_palette, a, at, b, bt, c, ct, is3DTex);
+      AddFace(vert_palette, uv_palette, a, at, b, bt, c, ct, is3DTex, corners);
       if (isQuad) {
-        AddFace(vert_palette, uv_palette, c, ct, d, dt, a, at, is3DTex);
+        AddFace(vert_palette, uv_palette, c, ct, d, dt, a, at, is3DTex, corners);
       }
     }
   }
 
-  //Setup GL
+  colliderBatch.Build(colliders);
+  const size_t stride = VertexSize(is3DTex);
+  uvSize = (is3DTex ? 3 : 2);
+  for (size_t i = 0; i < corners.size(); i += stride) {
+    bounds.Expand(Vector3(&corners[i]));
+  }
+
+  //Simulation-only runs just need the colliders
+  if (!GH_HAS_GL) {
+    return;
+  }
+
+  //Merge identical corners into shared vertices, then order the triangles
+  //for the post-transform cache and the vertices for fetching
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;
+  MergeVertices(corners, stride, vertices, indices);
+  const size_t numVerts = vertices.size() / stride;
+  const int64_t missesBefore = CacheMisses(indices, numVerts);
+  OptimizeVertexCache(indices, numVerts);
+  ReorderVertices(vertices, stride, indices);
+  numVertices = (GLsizei)numVerts;
+  numIndices = (GLsizei)indices.size();
+  indexType = (numVerts <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+  const size_t indexSize = (indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+
+  stats.faceVerts += corners.size() / stride;
+  stats.uniqueVerts += numVerts;
+  stats.arrayBytes += corners.size() * sizeof(float);
+  stats.indexedBytes += vertices.size() * sizeof(float) + indices.size() * indexSize;
+  stats.missesBefore += missesBefore;
+  stats.missesAfter += CacheMisses(indices, numVerts);
+  stats.triangles += indices.size() / 3;
+
+  //Setup GL, one interleaved buffer of position, uv and normal
   glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
-
-  glGenBuffers(NUM_VBOS, vbo);
-  {
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(verts[0]), verts.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-  }
-  {
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(uvs[0]), uvs.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, (is3DTex ? 3 : 2), GL_FLOAT, GL_FALSE, 0, 0);
-  }
-  {
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(normals[0]), normals.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  GLState::BindVertexArray(vao);
+
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+  SetVertexAttribs(uvSize);
+
+  glGenBuffers(1, &ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  if (indexType == GL_UNSIGNED_SHORT) {
+    const std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * indexSize, shortIndices.data(), GL_STATIC_DRAW);
+  } else {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * indexSize, indices.data(), GL_STATIC_DRAW);
   }
+
+  //Nothing is kept on the CPU side once it is uploaded
 }
 
 Mesh::~Mesh() {
-  glDeleteBuffers(NUM_VBOS, vbo);
-  glDeleteVertexArrays(1, &vao);
+  if (vao) {
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ibo);
+    glDeleteVertexArrays(1, &vao);
+    GLState::Invalidate();
+  }
 }
 
 void Mesh::Draw() {
-  glBindVertexArray(vao);
-  glDrawArrays(GL_TRIANGLES, 0, (GLsizei)verts.size());
+  GLState::BindVertexArray(vao);
+  GLState::DrawElements(GL_TRIANGLES, numIndices, indexType);
+}
+
+void Mesh::DrawInstanced(GLuint buffer, size_t offset, GLsizei count) {
+  GLState::BindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  SetInstanceAttribs(offset, !hasInstanceAttribs);
+  hasInstanceAttribs = true;
+  GLState::DrawElementsInstanced(GL_TRIANGLES, numIndices, indexType, count);
+}
+
+void Mesh::DrawIndirect(GLuint buffer, size_t offset, GLsizei count) {
+  GLState::BindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  SetInstanceAttribs(0, !hasInstanceAttribs);
+  hasInstanceAttribs = true;
+  GLState::MultiDrawElementsIndirect(GL_TRIANGLES, indexType, offset, count);
+}
+
+void Mesh::SetVertexAttribs(int uvFloats) {
+  const GLsizei stride_bytes = GLsizei((6 + uvFloats) * sizeof(float));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride_bytes, (const GLvoid*)0);
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, uvFloats, GL_FLOAT, GL_FALSE, stride_bytes, (const GLvoid*)(3 * sizeof(float)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride_bytes, (const GLvoid*)((3 + uvFloats) * sizeof(float)));
 }
 
-void Mesh::DebugDraw(const Camera& cam, const Matrix4& objMat) {
+void Mesh::SetInstanceAttribs(size_t offset, bool enable) {
+  for (int i = 0; i < NUM_INSTANCE_ATTRIBS; ++i) {
+    const GLuint loc = INSTANCE_ATTRIB + i;
+    if (enable) {
+      glEnableVertexAttribArray(loc);
+      glVertexAttribDivisor(loc, 1);
+    }
+    glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, INSTANCE_STRIDE, (const GLvoid*)(offset + i * 4 * sizeof(float)));
+  }
+}
+
+void Mesh::DebugDraw(const Camera& cam, const Affine3x4& objMat) {
   for (size_t i = 0; i < colliders.size(); ++i) {
     colliders[i].DebugDraw(cam, objMat);
   }
@@ -170,7 +250,8 @@ void Mesh::DebugDraw(const Camera& cam, const Matrix4& objMat) {
 
 void Mesh::AddFace(
   const std::vector<float>& vert_palette, const std::vector<float>& uv_palette,
-  uint32_t a, uint32_t at, uint32_t b, uint32_t bt, uint32_t c, uint32_t ct, bool is3DTex)
+  uint32_t a, uint32_t at, uint32_t b, uint32_t bt, uint32_t c, uint32_t ct, bool is3DTex,
+  std::vector<float>& corners)
 {
   //Merge texture and vertex indicies
   assert(a > 0 && b > 0 && c > 0);
@@ -190,26 +271,254 @@ void Mesh::AddFace(
     const uint32_t v = v_ix[i];
     const uint32_t vt = uv_ix[i];
     assert(v < vert_palette.size() / 3);
-    verts.push_back(vert_palette[v * 3]);
-    verts.push_back(vert_palette[v * 3 + 1]);
-    verts.push_back(vert_palette[v * 3 + 2]);
+    corners.push_back(vert_palette[v * 3]);
+    corners.push_back(vert_palette[v * 3 + 1]);
+    corners.push_back(vert_palette[v * 3 + 2]);
     if (!uv_palette.empty()) {
       if (is3DTex) {
         assert(vt < uv_palette.size() / 3);
-        uvs.push_back(uv_palette[vt * 3]);
-        uvs.push_back(uv_palette[vt * 3 + 1]);
-        uvs.push_back(uv_palette[vt * 3 + 2]);
+        corners.push_back(uv_palette[vt * 3]);
+        corners.push_back(uv_palette[vt * 3 + 1]);
+        corners.push_back(uv_palette[vt * 3 + 2]);
       } else {
         assert(vt < uv_palette.size() / 2);
-        uvs.push_back(uv_palette[vt * 2]);
-        uvs.push_back(uv_palette[vt * 2 + 1]);
+        corners.push_back(uv_palette[vt * 2]);
+        corners.push_back(uv_palette[vt * 2 + 1]);
       }
     } else {
-      uvs.push_back(0.0f);
-      uvs.push_back(0.0f);
+      corners.push_back(0.0f);
+      corners.push_back(0.0f);
+    }
+    corners.push_back(normal.x);
+    corners.push_back(normal.y);
+    corners.push_back(normal.z);
+  }
+}
+
+void Mesh::MergeVertices(const std::vector<float>& corners, size_t stride,
+                         std::vector<float>& vertices, std::vector<uint32_t>& indices) {
+  //Corners with the same position and uv share a vertex. Normals are flat
+  //and only read from the last vertex of each triangle, so triangles get
+  //rotated to end on a vertex that has no other normal yet. Only when none
+  //of its corners are free is a vertex duplicated.
+  static const uint32_t NONE = ~uint32_t(0);
+  const size_t keySize = stride - 3;
+  const float* data = corners.data();
+  auto less = [data, stride, keySize](uint32_t a, uint32_t b) {
+    return std::memcmp(data + a * stride, data + b * stride, keySize * sizeof(float)) < 0;
+  };
+  std::map<uint32_t, uint32_t, decltype(less)> firstVertex(less);
+  std::vector<uint32_t> nextVertex;  // other vertices with the same position and uv
+  std::vector<uint8_t> hasNormal;
+
+  auto addVertex = [&](uint32_t corner) {
+    const uint32_t v = uint32_t(nextVertex.size());
+    vertices.insert(vertices.end(), data + corner * stride, data + corner * stride + keySize);
+    vertices.insert(vertices.end(), 3, 0.0f);
+    nextVertex.push_back(NONE);
+    hasNormal.push_back(0);
+    return v;
+  };
+  auto findVertex = [&](uint32_t corner) {
+    auto it = firstVertex.find(corner);
+    if (it == firstVertex.end()) {
+      it = firstVertex.insert(std::make_pair(corner, addVertex(corner))).first;
+    }
+    return it->second;
+  };
+  auto claimVertex = [&](uint32_t corner, const float* normal, bool allowFree) {
+    for (uint32_t v = findVertex(corner); v != NONE; v = nextVertex[v]) {
+      float* vn = &vertices[v * stride + keySize];
+      if (hasNormal[v] && std::memcmp(vn, normal, 3 * sizeof(float)) == 0) {
+        return v;
+      } else if (!hasNormal[v] && allowFree) {
+        std::copy(normal, normal + 3, vn);
+        hasNormal[v] = 1;
+        return v;
+      }
+    }
+    return NONE;
+  };
+
+  const uint32_t numTris = uint32_t(corners.size() / (stride * 3));
+  indices.resize(numTris * 3);
+  for (uint32_t t = 0; t < numTris; ++t) {
+    const uint32_t c = t * 3;
+    const float* normal = data + c * stride + keySize;
+
+    //Prefer a vertex that already has this normal, then a free one
+    uint32_t last = 0;
+    uint32_t provoking = NONE;
+    for (int pass = 0; pass < 2 && provoking == NONE; ++pass) {
+      for (last = 0; last < 3 && provoking == NONE; ++last) {
+        provoking = claimVertex(c + last, normal, pass == 1);
+      }
+    }
+    if (provoking == NONE) {
+      last = 3;
+      const uint32_t first = findVertex(c + 2);
+      provoking = addVertex(c + 2);
+      std::copy(normal, normal + 3, &vertices[provoking * stride + keySize]);
+      hasNormal[provoking] = 1;
+      nextVertex[provoking] = nextVertex[first];
+      nextVertex[first] = provoking;
+    }
+    last -= 1;
+
+    //Rotating keeps the winding
+    indices[c] = findVertex(c + (last + 1) % 3);
+    indices[c + 1] = findVertex(c + (last + 2) % 3);
+    indices[c + 2] = provoking;
+  }
+}
+
+void Mesh::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t numVerts) {
+  //Tom Forsyth's linear-speed vertex cache optimisation. Triangles are added
+  //greedily by a score that favours vertices already in a simulated LRU cache
+  //and vertices with few triangles left to use them.
+  static const int CACHE_SIZE = 32;
+  const size_t numTris = indices.size() / 3;
+  if (numTris == 0) {
+    return;
+  }
+
+  //Triangles that still need each vertex
+  std::vector<uint32_t> triStart(numVerts + 1, 0);
+  for (size_t i = 0; i < indices.size(); ++i) {
+    triStart[indices[i] + 1] += 1;
+  }
+  for (size_t v = 0; v < numVerts; ++v) {
+    triStart[v + 1] += triStart[v];
+  }
+  std::vector<uint32_t> liveTris(numVerts, 0);
+  std::vector<uint32_t> vertTris(indices.size());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    const uint32_t v = indices[i];
+    vertTris[triStart[v] + liveTris[v]++] = uint32_t(i / 3);
+  }
+
+  auto vertexScore = [](int cachePos, uint32_t live) {
+    if (live == 0) {
+      return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePos >= 3) {
+      score = std::pow(1.0f - float(cachePos - 3) / float(CACHE_SIZE - 3), 1.5f);
+    } else if (cachePos >= 0) {
+      score = 0.75f;
+    }
+    return score + 2.0f / std::sqrt(float(live));
+  };
+
+  std::vector<int> cachePos(numVerts, -1);
+  std::vector<float> vertScore(numVerts);
+  for (size_t v = 0; v < numVerts; ++v) {
+    vertScore[v] = vertexScore(-1, liveTris[v]);
+  }
+  std::vector<float> triScore(numTris);
+  std::vector<uint8_t> triAdded(numTris, 0);
+  for (size_t t = 0; t < numTris; ++t) {
+    triScore[t] = vertScore[indices[t * 3]] + vertScore[indices[t * 3 + 1]] + vertScore[indices[t * 3 + 2]];
+  }
+
+  std::vector<uint32_t> output;
+  output.reserve(indices.size());
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> newCache;
+  size_t bestTri = 0;
+  for (size_t t = 1; t < numTris; ++t) {
+    if (triScore[t] > triScore[bestTri]) { bestTri = t; }
+  }
+  size_t nextScan = 0;
+  for (size_t n = 0; n < numTris; ++n) {
+    //Nothing in the cache has triangles left, take the next unused one
+    if (bestTri == numTris) {
+      while (triAdded[nextScan]) { ++nextScan; }
+      bestTri = nextScan;
+    }
+
+    //Add the triangle and take it off its vertices' lists
+    const uint32_t* tri = &indices[bestTri * 3];
+    triAdded[bestTri] = 1;
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = tri[k];
+      output.push_back(v);
+      uint32_t* list = &vertTris[triStart[v]];
+      for (uint32_t j = 0; j < liveTris[v]; ++j) {
+        if (list[j] == bestTri) {
+          list[j] = list[--liveTris[v]];
+          break;
+        }
+      }
+    }
+
+    //Its vertices move to the front of the cache
+    newCache.assign(tri, tri + 3);
+    for (size_t j = 0; j < cache.size(); ++j) {
+      if (cache[j] != tri[0] && cache[j] != tri[1] && cache[j] != tri[2]) {
+        newCache.push_back(cache[j]);
+      }
+    }
+    for (size_t j = CACHE_SIZE; j < newCache.size(); ++j) {
+      cachePos[newCache[j]] = -1;
+      vertScore[newCache[j]] = vertexScore(-1, liveTris[newCache[j]]);
+    }
+    newCache.resize(GH_MIN(newCache.size(), size_t(CACHE_SIZE)));
+    cache.swap(newCache);
+
+    //Rescore what's in the cache and pick the best triangle touching it
+    for (size_t j = 0; j < cache.size(); ++j) {
+      cachePos[cache[j]] = int(j);
+      vertScore[cache[j]] = vertexScore(int(j), liveTris[cache[j]]);
+    }
+    bestTri = numTris;
+    float bestScore = -1.0f;
+    for (size_t j = 0; j < cache.size(); ++j) {
+      const uint32_t v = cache[j];
+      for (uint32_t k = 0; k < liveTris[v]; ++k) {
+        const uint32_t t = vertTris[triStart[v] + k];
+        const float score = vertScore[indices[t * 3]] + vertScore[indices[t * 3 + 1]] + vertScore[indices[t * 3 + 2]];
+        triScore[t] = score;
+        if (score > bestScore) {
+          bestScore = score;
+          bestTri = t;
+        }
+      }
+    }
+  }
+  indices.swap(output);
+}
+
+void Mesh::ReorderVertices(std::vector<float>& vertices, size_t stride, std::vector<uint32_t>& indices) {
+  //Put vertices in the order they are first used
+  static const uint32_t UNUSED = ~uint32_t(0);
+  const size_t numVerts = vertices.size() / stride;
+  std::vector<uint32_t> remap(numVerts, UNUSED);
+  std::vector<float> reordered(vertices.size());
+  uint32_t next = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    const uint32_t v = indices[i];
+    if (remap[v] == UNUSED) {
+      remap[v] = next;
+      std::copy(&vertices[v * stride], &vertices[v * stride] + stride, &reordered[next * stride]);
+      next += 1;
+    }
+    indices[i] = remap[v];
+  }
+  reordered.resize(next * stride);
+  vertices.swap(reordered);
+}
+
+int64_t Mesh::CacheMisses(const std::vector<uint32_t>& indices, size_t numVerts) {
+  //Simulated 16 entry FIFO, the usual size for measuring this
+  static const int FIFO_SIZE = 16;
+  std::vector<int64_t> insertedAt(numVerts, -FIFO_SIZE - 1);
+  int64_t misses = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (misses - insertedAt[indices[i]] > FIFO_SIZE) {
+      insertedAt[indices[i]] = misses;
+      misses += 1;
     }
-    normals.push_back(normal.x);
-    normals.push_back(normal.y);
-    normals.push_back(normal.z);
   }
+  return misses;
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "Collider.h"
+#include "ColliderBatch.h"
 #include "Camera.h"
 #include <GL/glew.h>
 #include <vector>
@@ -7,26 +8,79 @@
 
 class Mesh {
 public:
-  static const int NUM_VBOS = 3;
+  //Position, uv and normal, interleaved in one buffer
+  static const int NUM_ATTRIBS = 3;
+
+  //Per instance rows of the local to world matrix, one attribute per row
+  static const GLuint INSTANCE_ATTRIB = NUM_ATTRIBS;
+  static const int NUM_INSTANCE_ATTRIBS = 3;
+  static const int INSTANCE_STRIDE = NUM_INSTANCE_ATTRIBS * 4 * sizeof(float);
 
   Mesh(const char* fname);
   ~Mesh();
 
   void Draw();
+  //Draws count copies using the transforms at offset in the buffer
+  void DrawInstanced(GLuint buffer, size_t offset, GLsizei count);
+  //Draws the commands at offset in the bound indirect buffer, with base
+  //instances picking transforms in the buffer
+  void DrawIndirect(GLuint buffer, size_t offset, GLsizei count);
+
+  void DebugDraw(const Camera& cam, const Affine3x4& objMat);
+
+  //Uploaded buffers, so static meshes can be merged on the GPU
+  GLuint VertexBuffer() const { return vbo; }
+  GLuint IndexBuffer() const { return ibo; }
+  GLsizei NumVertices() const { return numVertices; }
+  GLsizei NumIndices() const { return numIndices; }
+  GLenum IndexType() const { return indexType; }
+  int UVSize() const { return uvSize; }
 
-  void DebugDraw(const Camera& cam, const Matrix4& objMat);
+  //Points the bound vertex array at vertices laid out like a mesh's, or at
+  //transforms, in the bound array buffer
+  static void SetVertexAttribs(int uvFloats);
+  static void SetInstanceAttribs(size_t offset, bool enable);
 
   std::vector<Collider> colliders;
+  ColliderBatch colliderBatch;
+
+  //Bounds of the triangles in mesh space
+  AABB bounds;
+
+  //Totals over every mesh uploaded so far
+  struct UploadStats {
+    int64_t faceVerts;     // vertices if every face had its own
+    int64_t uniqueVerts;   // vertices after merging identical ones
+    int64_t arrayBytes;    // unindexed buffers with a vertex per face corner
+    int64_t indexedBytes;  // vertex and index buffers actually uploaded
+    int64_t triangles;
+    int64_t missesBefore;  // vertex cache misses in file order
+    int64_t missesAfter;   // and after reordering
+  };
+  static const UploadStats& Stats() { return stats; }
 
 private:
   void AddFace(
     const std::vector<float>& vert_palette, const std::vector<float>& uv_palette,
-    uint32_t a, uint32_t at, uint32_t b, uint32_t bt, uint32_t c, uint32_t ct, bool is3DTex);
+    uint32_t a, uint32_t at, uint32_t b, uint32_t bt, uint32_t c, uint32_t ct, bool is3DTex,
+    std::vector<float>& corners);
+
+  //Floats per vertex
+  static size_t VertexSize(bool is3DTex) { return (is3DTex ? 9 : 8); }
+  static void MergeVertices(const std::vector<float>& corners, size_t stride,
+                            std::vector<float>& vertices, std::vector<uint32_t>& indices);
+  static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t numVerts);
+  static void ReorderVertices(std::vector<float>& vertices, size_t stride, std::vector<uint32_t>& indices);
+  static int64_t CacheMisses(const std::vector<uint32_t>& indices, size_t numVerts);
 
   GLuint vao;
-  GLuint vbo[NUM_VBOS];
+  GLuint vbo;
+  GLuint ibo;
+  GLsizei numVertices;
+  GLsizei numIndices;
+  GLenum indexType;
+  int uvSize;
+  bool hasInstanceAttribs;
 
-  std::vector<float> verts;
-  std::vector<float> uvs;
-  std::vector<float> normals;
+  static UploadStats stats;
 };
@@ -1,4 +1,5 @@
 #include "Object.h"
+#include "Engine.h"
 #include "Mesh.h"
 #include "Shader.h"
 #include "Texture.h"
@@ -7,7 +8,10 @@ Object::Object() :
   pos(0.0f),
   euler(0.0f),
   scale(1.0f),
-  p_scale(1.0f) {
+  p_scale(1.0f),
+  isStatic(true),
+  transform(0),
+  transformValid(false) {
 }
 
 void Object::Reset() {
@@ -18,28 +22,64 @@ void Object::Reset() {
 }
 
 void Object::Draw(const Camera& cam, uint32_t curFBO) {
+  RenderQueue queue;
+  Enqueue(queue, cam);
+  queue.Flush(GH_ENGINE->GetTransforms());
+}
+
+void Object::Enqueue(RenderQueue& queue, const Camera& cam) {
   if (shader && mesh) {
-    const Matrix4 mv = WorldToLocal().Transposed();
-    const Matrix4 mvp = cam.Matrix() * LocalToWorld();
-    shader->Use();
-    if (texture) {
-      texture->Use();
-    }
-    shader->SetMVP(mvp.m, mv.m);
-    mesh->Draw();
+    const float depth = -cam.worldView.MulPoint(LocalToWorld().Translation()).z;
+    queue.Add(shader.get(), texture.get(), mesh.get(), transform, depth);
   }
 }
 
-Vector3 Object::Forward() const {
-  return -(Matrix4::RotZ(euler.z) * Matrix4::RotX(euler.x) * Matrix4::RotY(euler.y)).ZAxis();
+void Object::WriteTransforms(TransformBuffer& buffer) {
+  if (mesh) {
+    transform = buffer.Add(LocalToWorld());
+  }
 }
 
-Matrix4 Object::LocalToWorld() const {
-  return Matrix4::Trans(pos) * Matrix4::RotY(euler.y) * Matrix4::RotX(euler.x) * Matrix4::RotZ(euler.z) * Matrix4::Scale(scale * p_scale);
+AABB Object::WorldBounds() const {
+  return (mesh ? mesh->bounds.Transformed(LocalToWorld()) : AABB());
 }
 
-Matrix4 Object::WorldToLocal() const {
-  return Matrix4::Scale(1.0f / (scale * p_scale)) * Matrix4::RotZ(-euler.z) * Matrix4::RotX(-euler.x) * Matrix4::RotY(-euler.y) * Matrix4::Trans(-pos);
+const Vector3& Object::Forward() const {
+  UpdateTransform();
+  return forward;
+}
+
+const Affine3x4& Object::LocalToWorld() const {
+  UpdateTransform();
+  return localToWorld;
+}
+
+const Affine3x4& Object::WorldToLocal() const {
+  UpdateTransform();
+  return worldToLocal;
+}
+
+void Object::UpdateTransform() const {
+  //Nothing to do if the transform hasn't changed
+  if (transformValid && p_scale == cachedPScale &&
+      pos.x == cachedPos.x && pos.y == cachedPos.y && pos.z == cachedPos.z &&
+      euler.x == cachedEuler.x && euler.y == cachedEuler.y && euler.z == cachedEuler.z &&
+      scale.x == cachedScale.x && scale.y == cachedScale.y && scale.z == cachedScale.z) {
+    return;
+  }
+
+  const Affine3x4 rotY = Affine3x4::RotY(euler.y);
+  const Affine3x4 rotX = Affine3x4::RotX(euler.x);
+  const Affine3x4 rotZ = Affine3x4::RotZ(euler.z);
+  localToWorld = Affine3x4::Trans(pos) * rotY * rotX * rotZ * Affine3x4::Scale(scale * p_scale);
+  worldToLocal = localToWorld.InverseOrthogonal();
+  forward = -(rotZ * rotX * rotY).ZAxis();
+
+  cachedPos = pos;
+  cachedEuler = euler;
+  cachedScale = scale;
+  cachedPScale = p_scale;
+  transformValid = true;
 }
 
 void Object::DebugDraw(const Camera& cam) {
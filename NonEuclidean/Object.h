@@ -2,12 +2,15 @@
 #include "GameHeader.h"
 #include "Vector.h"
 #include "Camera.h"
+#include "RenderQueue.h"
 #include "Sphere.h"
+#include "TransformBuffer.h"
 #include <vector>
 #include <memory>
 
 //Forward declarations
 class Physical;
+class Particles;
 class Mesh;
 class Texture;
 class Shader;
@@ -19,18 +22,31 @@ public:
 
   virtual void Reset();
   virtual void Draw(const Camera& cam, uint32_t curFBO);
+  //Adds the object's draws to a queue instead of drawing them right away.
+  //Uses the transforms written to the frame's TransformBuffer.
+  virtual void Enqueue(RenderQueue& queue, const Camera& cam);
+  //Writes the transforms its draws use, once per frame
+  virtual size_t NumTransforms() const { return (mesh ? 1 : 0); }
+  virtual void WriteTransforms(TransformBuffer& buffer);
   virtual void Update() {};
-  virtual void OnHit(Object& other, Vector3& push) {};
+  //Called after the collision pass, in a fixed order, for each push applied to other
+  virtual void OnHit(Object& other, const Vector3& push) {};
 
   //Casts
   virtual Physical* AsPhysical() { return nullptr; }
   const Physical* AsPhysical() const { return const_cast<Object*>(this)->AsPhysical(); }
+  virtual Particles* AsParticles() { return nullptr; }
+  const Particles* AsParticles() const { return const_cast<Object*>(this)->AsParticles(); }
 
   void DebugDraw(const Camera& cam);
 
-  Matrix4 LocalToWorld() const;
-  Matrix4 WorldToLocal() const;
-  Vector3 Forward() const;
+  //Transforms are cached and only rebuilt when pos/euler/scale/p_scale change
+  const Affine3x4& LocalToWorld() const;
+  const Affine3x4& WorldToLocal() const;
+  const Vector3& Forward() const;
+
+  //World space box around everything the object draws
+  virtual AABB WorldBounds() const;
 
   Vector3 pos;
   Vector3 euler;
@@ -39,8 +55,27 @@ public:
   // Physical scale, only updated by portal scale changes
   float p_scale;
 
+  // Static objects never move after the scene loads and are never updated
+  bool isStatic;
+
   std::shared_ptr<Mesh> mesh;
   std::shared_ptr<Texture> texture;
   std::shared_ptr<Shader> shader;
+
+  //Where WriteTransforms put this frame's transform
+  uint32_t transform;
+
+private:
+  void UpdateTransform() const;
+
+  //Cached transforms and the state they were built from
+  mutable Affine3x4 localToWorld;
+  mutable Affine3x4 worldToLocal;
+  mutable Vector3 forward;
+  mutable Vector3 cachedPos;
+  mutable Vector3 cachedEuler;
+  mutable Vector3 cachedScale;
+  mutable float cachedPScale;
+  mutable bool transformValid;
 };
 typedef std::vector<std::shared_ptr<Object>> PObjectVec;
@@ -0,0 +1,275 @@
+#include "Particles.h"
+#include "Mesh.h"
+#include "Shader.h"
+#include "Texture.h"
+
+Particles::Particles() :
+  gravity(0.0f, GH_GRAVITY, 0.0f),
+  bounce(0.0f),
+  friction(0.0f),
+  drag(0.0f) {
+  isStatic = false;
+}
+
+int Particles::Add(const Vector3& pos, const Vector3& vel, float r) {
+  px.push_back(pos.x); py.push_back(pos.y); pz.push_back(pos.z);
+  vx.push_back(vel.x); vy.push_back(vel.y); vz.push_back(vel.z);
+  ox.push_back(pos.x); oy.push_back(pos.y); oz.push_back(pos.z);
+  radius.push_back(r);
+  pscale.push_back(1.0f);
+  return Size() - 1;
+}
+
+void Particles::Remove(int i) {
+  //Swap with the last one, particles don't keep their order
+  const int last = Size() - 1;
+  std::vector<float>* arrays[] = { &px, &py, &pz, &vx, &vy, &vz, &ox, &oy, &oz, &radius, &pscale };
+  for (size_t a = 0; a < sizeof(arrays) / sizeof(arrays[0]); ++a) {
+    (*arrays[a])[i] = (*arrays[a])[last];
+    arrays[a]->pop_back();
+  }
+}
+
+void Particles::Clear() {
+  px.clear(); py.clear(); pz.clear();
+  vx.clear(); vy.clear(); vz.clear();
+  ox.clear(); oy.clear(); oz.clear();
+  radius.clear();
+  pscale.clear();
+}
+
+void Particles::Enqueue(RenderQueue& queue, const Camera& cam) {
+  if (!shader || !mesh) {
+    return;
+  }
+  //Particles' transforms were written one after another
+  for (int i = 0; i < Size(); ++i) {
+    const float depth = -cam.worldView.MulPoint(Position(i)).z;
+    queue.Add(shader.get(), texture.get(), mesh.get(), transform + uint32_t(i), depth);
+  }
+}
+
+void Particles::WriteTransforms(TransformBuffer& buffer) {
+  //The bounds are built here too, so views culling the particles don't
+  //have to visit each of them again
+  bounds = AABB();
+  if (!mesh) {
+    return;
+  }
+  for (int i = 0; i < Size(); ++i) {
+    const Affine3x4 localToWorld = Affine3x4::Trans(Position(i)) * Affine3x4::Scale(scale * (radius[i] * pscale[i]));
+    const uint32_t slot = buffer.Add(localToWorld);
+    if (i == 0) {
+      transform = slot;
+    }
+    bounds.Expand(mesh->bounds.Transformed(localToWorld));
+  }
+}
+
+void Particles::Step(int begin, int end, const Broadphase& broadphase, const PObjectVec& objs, const PPortalVec& portals,
+                     std::vector<Broadphase::ColliderRef>& candidates, std::vector<int>& scratch) {
+  Integrate(begin, end);
+  for (int i = begin; i < end; ++i) {
+    Collide(i, broadphase, objs, portals, candidates, scratch);
+  }
+  TryPortals(begin, end, portals);
+}
+
+void Particles::Integrate(int begin, int end) {
+  int i = begin;
+#if GH_USE_SSE
+  const float damp = 1.0f - GH_STEP_DECAY(drag);
+  //Same operation order as the scalar version, so results match exactly
+  const __m128 gx = _mm_set1_ps(gravity.x);
+  const __m128 gy = _mm_set1_ps(gravity.y);
+  const __m128 gz = _mm_set1_ps(gravity.z);
+  const __m128 dt = _mm_set1_ps(GH_DT);
+  const __m128 d = _mm_set1_ps(damp);
+  for (; i + 4 <= end; i += 4) {
+    const __m128 s = _mm_loadu_ps(&pscale[i]);
+    __m128 x = _mm_loadu_ps(&px[i]), y = _mm_loadu_ps(&py[i]), z = _mm_loadu_ps(&pz[i]);
+    _mm_storeu_ps(&ox[i], x); _mm_storeu_ps(&oy[i], y); _mm_storeu_ps(&oz[i], z);
+    __m128 u = _mm_add_ps(_mm_loadu_ps(&vx[i]), _mm_mul_ps(_mm_mul_ps(gx, s), dt));
+    __m128 v = _mm_add_ps(_mm_loadu_ps(&vy[i]), _mm_mul_ps(_mm_mul_ps(gy, s), dt));
+    __m128 w = _mm_add_ps(_mm_loadu_ps(&vz[i]), _mm_mul_ps(_mm_mul_ps(gz, s), dt));
+    u = _mm_mul_ps(u, d); v = _mm_mul_ps(v, d); w = _mm_mul_ps(w, d);
+    _mm_storeu_ps(&vx[i], u); _mm_storeu_ps(&vy[i], v); _mm_storeu_ps(&vz[i], w);
+    _mm_storeu_ps(&px[i], _mm_add_ps(x, _mm_mul_ps(u, dt)));
+    _mm_storeu_ps(&py[i], _mm_add_ps(y, _mm_mul_ps(v, dt)));
+    _mm_storeu_ps(&pz[i], _mm_add_ps(z, _mm_mul_ps(w, dt)));
+  }
+#endif
+  IntegrateScalar(i, end);
+}
+
+void Particles::IntegrateScalar(int begin, int end) {
+  const float damp = 1.0f - GH_STEP_DECAY(drag);
+  for (int i = begin; i < end; ++i) {
+    ox[i] = px[i]; oy[i] = py[i]; oz[i] = pz[i];
+    vx[i] = (vx[i] + gravity.x * pscale[i] * GH_DT) * damp;
+    vy[i] = (vy[i] + gravity.y * pscale[i] * GH_DT) * damp;
+    vz[i] = (vz[i] + gravity.z * pscale[i] * GH_DT) * damp;
+    px[i] += vx[i] * GH_DT;
+    py[i] += vy[i] * GH_DT;
+    pz[i] += vz[i] * GH_DT;
+  }
+}
+
+void Particles::Collide(int i, const Broadphase& broadphase, const PObjectVec& objs, const PPortalVec& portals,
+                        std::vector<Broadphase::ColliderRef>& candidates, std::vector<int>& scratch) {
+  const float r = radius[i] * pscale[i];
+  const Vector3 prev(ox[i], oy[i], oz[i]);
+  Vector3 pos = Position(i);
+  const Vector3 motion = pos - prev;
+
+  //Only colliders near the particle's path can touch it
+  AABB bounds = AABB::FromCenter(pos, Vector3(0.0f));
+  bounds.Expand(prev);
+  bounds.Inflate(r * 2.0f);
+  broadphase.Query(bounds, candidates, scratch);
+  if (candidates.empty()) {
+    return;
+  }
+
+  //Sweep first so fast particles can't pass through thin colliders,
+  //stopping early at a portal since anything behind it is elsewhere
+  if (motion.MagSq() > 0.0f) {
+    float tMax = 1.0f;
+    for (size_t p = 0; p < portals.size(); ++p) {
+      float t;
+      const Vector3 bump = portals[p]->GetBump(prev) * (2 * GH_NEAR_MIN * pscale[i]);
+      if (portals[p]->Intersects(prev, pos, bump, &t)) {
+        tMax = GH_MIN(tMax, t);
+      }
+    }
+    float tHit = tMax;
+    const Affine3x4 worldToUnit = Affine3x4::Scale(1.0f / r) * Affine3x4::Trans(-pos);
+    const Vector3 start = worldToUnit.MulDirection(-motion);
+    for (size_t k = 0; k < candidates.size();) {
+      const Object& obj = *objs[candidates[k].obj];
+      const Affine3x4 localToUnit = worldToUnit * obj.LocalToWorld();
+      size_t kEnd = k + 1;
+      while (kEnd < candidates.size() && candidates[kEnd].obj == candidates[k].obj) { ++kEnd; }
+      for (; k < kEnd; k += ColliderBatch::WIDTH) {
+        uint32_t ix[ColliderBatch::WIDTH];
+        int count = 0;
+        for (; count < ColliderBatch::WIDTH && k + count < kEnd; ++count) {
+          ix[count] = candidates[k + count].collider;
+        }
+        tHit = GH_MIN(tHit, obj.mesh->colliderBatch.Sweep(localToUnit, start, ix, count));
+      }
+      k = kEnd;
+    }
+    if (tHit < tMax) {
+      pos = prev + motion * tHit;
+      px[i] = pos.x; py[i] = pos.y; pz[i] = pos.z;
+    }
+  }
+
+  //Push out of everything nearby, retesting after each push like bodies do
+  for (size_t k = 0; k < candidates.size();) {
+    const Object& obj = *objs[candidates[k].obj];
+    const ColliderBatch& batch = obj.mesh->colliderBatch;
+    size_t kEnd = k + 1;
+    while (kEnd < candidates.size() && candidates[kEnd].obj == candidates[k].obj) { ++kEnd; }
+    Affine3x4 localToUnit = Affine3x4::Scale(1.0f / r) * Affine3x4::Trans(-Position(i)) * obj.LocalToWorld();
+    for (size_t c = k; c < kEnd;) {
+      uint32_t ix[ColliderBatch::WIDTH];
+      Vector3 pushes[ColliderBatch::WIDTH];
+      int count = 0;
+      for (; count < ColliderBatch::WIDTH && c + count < kEnd; ++count) {
+        ix[count] = candidates[c + count].collider;
+      }
+      const uint32_t hits = batch.Collide(localToUnit, ix, count, pushes);
+      if (hits == 0) {
+        c += count;
+        continue;
+      }
+      int h = 0;
+      while ((hits & (1u << h)) == 0) { ++h; }
+      c += h + 1;
+      Respond(i, pushes[h] * r);
+      localToUnit = Affine3x4::Scale(1.0f / r) * Affine3x4::Trans(-Position(i)) * obj.LocalToWorld();
+    }
+    k = kEnd;
+  }
+}
+
+void Particles::Respond(int i, const Vector3& push) {
+  px[i] += push.x; py[i] += push.y; pz[i] += push.z;
+
+  //Same response as Physical::OnCollide, without the high friction mode
+  const float stepRatioSq = (GH_DT / GH_TUNED_DT) * (GH_DT / GH_TUNED_DT);
+  if (push.MagSq() < 1e-8f * pscale[i] * stepRatioSq * stepRatioSq) {
+    return;
+  }
+  const float kinetic_friction = GH_STEP_DECAY(friction);
+  const Vector3 velocity = Velocity(i);
+  const Vector3 push_proj = push * (velocity.Dot(push) / push.Dot(push));
+  const Vector3 v = (velocity - push_proj) * (1.0f - kinetic_friction) - push_proj * bounce;
+  vx[i] = v.x; vy[i] = v.y; vz[i] = v.z;
+}
+
+void Particles::TryPortals(int begin, int end, const PPortalVec& portals) {
+  for (int i = begin; i < end; i += 4) {
+    const int count = GH_MIN(end - i, 4);
+    uint32_t warped = 0;
+    for (size_t p = 0; p < portals.size(); ++p) {
+      //Cheap test of four particles against the portal plane first. The bump
+      //moves the plane by at most bumpSize, so anything that stays farther
+      //away on one side can't cross it.
+      const Portal& portal = *portals[p];
+      const Vector3 n = portal.Forward();
+      const float d = n.Dot(portal.pos);
+      uint32_t nearby = 0;
+#if GH_USE_SSE
+      if (count == 4) {
+        const __m128 nx = _mm_set1_ps(n.x), ny = _mm_set1_ps(n.y), nz = _mm_set1_ps(n.z);
+        const __m128 nd = _mm_set1_ps(d);
+        const __m128 bumpSize = _mm_mul_ps(_mm_set1_ps(4 * GH_NEAR_MIN), _mm_loadu_ps(&pscale[i]));
+        const __m128 da = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(&ox[i])), _mm_mul_ps(ny, _mm_loadu_ps(&oy[i]))), _mm_mul_ps(nz, _mm_loadu_ps(&oz[i]))), nd);
+        const __m128 db = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(&px[i])), _mm_mul_ps(ny, _mm_loadu_ps(&py[i]))), _mm_mul_ps(nz, _mm_loadu_ps(&pz[i]))), nd);
+        const __m128 lo = _mm_cmple_ps(_mm_min_ps(da, db), bumpSize);
+        const __m128 hi = _mm_cmpge_ps(_mm_max_ps(da, db), _mm_sub_ps(_mm_setzero_ps(), bumpSize));
+        nearby = uint32_t(_mm_movemask_ps(_mm_and_ps(lo, hi)));
+      } else
+#endif
+      {
+        for (int l = 0; l < count; ++l) {
+          const float bumpSize = 4 * GH_NEAR_MIN * pscale[i + l];
+          const float da = n.x * ox[i + l] + n.y * oy[i + l] + n.z * oz[i + l] - d;
+          const float db = n.x * px[i + l] + n.y * py[i + l] + n.z * pz[i + l] - d;
+          if (GH_MIN(da, db) <= bumpSize && GH_MAX(da, db) >= -bumpSize) {
+            nearby |= (1u << l);
+          }
+        }
+      }
+
+      //Exact test for the few that get close, one portal per particle per step
+      nearby &= ~warped;
+      for (int l = 0; nearby != 0; ++l, nearby >>= 1) {
+        if ((nearby & 1) && TryPortal(i + l, portal)) {
+          warped |= (1u << l);
+        }
+      }
+    }
+  }
+}
+
+bool Particles::TryPortal(int i, const Portal& portal) {
+  const Vector3 prev(ox[i], oy[i], oz[i]);
+  const Vector3 bump = portal.GetBump(prev) * (2 * GH_NEAR_MIN * pscale[i]);
+  const Portal::Warp* warp = portal.Intersects(prev, Position(i), bump);
+  if (!warp) {
+    return false;
+  }
+
+  //Teleport the particle, same as Physical::TryPortal
+  const Vector3 pos = warp->deltaInv.MulPoint(Position(i) - bump * 2);
+  const Vector3 vel = warp->deltaInv.MulDirection(Velocity(i));
+  px[i] = pos.x; py[i] = pos.y; pz[i] = pos.z;
+  vx[i] = vel.x; vy[i] = vel.y; vz[i] = vel.z;
+  ox[i] = pos.x; oy[i] = pos.y; oz[i] = pos.z;
+  pscale[i] *= warp->deltaInv.XAxis().Mag();
+  return true;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "Object.h"
+#include "Broadphase.h"
+#include "Portal.h"
+#include <vector>
+
+//Large numbers of sphere bodies kept in flat arrays instead of one Physical
+//each. They collide with the scene and go through portals like a Physical,
+//but share their material and never push anything else.
+class Particles : public Object {
+public:
+  Particles();
+  virtual ~Particles() override {}
+
+  virtual void Enqueue(RenderQueue& queue, const Camera& cam) override;
+  virtual size_t NumTransforms() const override { return (mesh ? px.size() : 0); }
+  virtual void WriteTransforms(TransformBuffer& buffer) override;
+  //As of the last WriteTransforms, which every frame does before culling
+  virtual AABB WorldBounds() const override { return bounds; }
+  virtual Particles* AsParticles() override { return this; }
+
+  int Add(const Vector3& pos, const Vector3& vel, float radius);
+  void Remove(int i);
+  void Clear();
+  int Size() const { return (int)px.size(); }
+
+  Vector3 Position(int i) const { return Vector3(px[i], py[i], pz[i]); }
+  Vector3 Velocity(int i) const { return Vector3(vx[i], vy[i], vz[i]); }
+
+  //Runs one physics step for the particles in [begin, end). Ranges that
+  //don't overlap can be stepped on different threads.
+  void Step(int begin, int end, const Broadphase& broadphase, const PObjectVec& objs, const PPortalVec& portals,
+            std::vector<Broadphase::ColliderRef>& candidates, std::vector<int>& scratch);
+
+  //Integrate gravity, drag and velocity, same as Physical::Update
+  void Integrate(int begin, int end);
+  void IntegrateScalar(int begin, int end);
+
+  //Shared by every particle
+  Vector3 gravity;
+  float bounce;
+  float friction;
+  float drag;
+
+private:
+  void Collide(int i, const Broadphase& broadphase, const PObjectVec& objs, const PPortalVec& portals,
+               std::vector<Broadphase::ColliderRef>& candidates, std::vector<int>& scratch);
+  void Respond(int i, const Vector3& push);
+  void TryPortals(int begin, int end, const PPortalVec& portals);
+  bool TryPortal(int i, const Portal& portal);
+
+  //Position, velocity and position at the start of the step
+  std::vector<float> px, py, pz;
+  std::vector<float> vx, vy, vz;
+  std::vector<float> ox, oy, oz;
+
+  //Radius and the physical scale picked up from portals
+  std::vector<float> radius;
+  std::vector<float> pscale;
+
+  AABB bounds;
+};
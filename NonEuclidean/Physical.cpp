@@ -1,7 +1,8 @@
 #include "Physical.h"
 #include "GameHeader.h"
 
-Physical::Physical() {
+Physical::Physical() : canSleep(true) {
+  isStatic = false;
   Reset();
 }
 
@@ -14,12 +15,14 @@ void Physical::Reset() {
   high_friction = 0.0f;
   drag = 0.0f;
   prev_pos.SetZero();
+  sleeping = false;
+  restTime = 0.0f;
 }
 
 void Physical::Update() {
   prev_pos = pos;
   velocity += gravity * p_scale * GH_DT;
-  velocity *= (1.0f - drag);
+  velocity *= (1.0f - GH_STEP_DECAY(drag));
   pos += velocity * GH_DT;
 }
 
@@ -27,8 +30,10 @@ void Physical::OnCollide(Object& other, const Vector3& push) {
   //Update position to avoid collision
   pos += push;
 
-  //Ignore push if delta is too small
-  if (push.MagSq() < 1e-8f * p_scale) {
+  //Ignore push if delta is too small. Resting pushes grow with the square of
+  //the step size, so the threshold is scaled to keep the same behavior.
+  const float stepRatioSq = (GH_DT / GH_TUNED_DT) * (GH_DT / GH_TUNED_DT);
+  if (push.MagSq() < 1e-8f * p_scale * stepRatioSq * stepRatioSq) {
     return;
   }
 
@@ -40,10 +45,15 @@ void Physical::OnCollide(Object& other, const Vector3& push) {
   }
 
   //Update velocity to react to collision
+  kinetic_friction = GH_STEP_DECAY(kinetic_friction);
   const Vector3 push_proj = push * (velocity.Dot(push) / push.Dot(push));
   velocity = (velocity - push_proj) * (1.0f - kinetic_friction) - push_proj * bounce;
 }
 
+void Physical::OnHit(Object&, const Vector3&) {
+  Wake();
+}
+
 bool Physical::TryPortal(const Portal& portal) {
   const Vector3 bump = portal.GetBump(prev_pos) * (2 * GH_NEAR_MIN * p_scale);
   const Portal::Warp* warp = portal.Intersects(prev_pos, pos, bump);
@@ -64,3 +74,40 @@ bool Physical::TryPortal(const Portal& portal) {
   }
   return false;
 }
+
+void Physical::UpdateSleep() {
+  if (!canSleep) {
+    return;
+  }
+  const float maxMove = GH_SLEEP_SPEED * GH_DT * p_scale;
+  if ((pos - prev_pos).MagSq() < maxMove * maxMove) {
+    restTime += GH_DT;
+    if (restTime >= GH_SLEEP_TIME) {
+      sleeping = true;
+      velocity.SetZero();
+    }
+  } else {
+    restTime = 0.0f;
+  }
+}
+
+void Physical::Wake() {
+  sleeping = false;
+  restTime = 0.0f;
+}
+
+AABB Physical::HitBounds() const {
+  //World bounds of all hit spheres over the last step, padded by a radius for collision pushes
+  const Affine3x4& localToWorld = LocalToWorld();
+  const float s = GH_MAX(GH_MAX(scale.x, scale.y), scale.z) * p_scale;
+  const Vector3 motion = pos - prev_pos;
+  AABB bounds;
+  for (size_t i = 0; i < hitSpheres.size(); ++i) {
+    const Vector3 center = localToWorld.MulPoint(hitSpheres[i].center);
+    AABB sphere = AABB::FromCenter(center, Vector3(0.0f));
+    sphere.Expand(center - motion);
+    sphere.Inflate(hitSpheres[i].radius * s * 2.0f);
+    bounds.Expand(sphere);
+  }
+  return bounds;
+}
@@ -2,6 +2,7 @@
 #include "Object.h"
 #include "Portal.h"
 #include "Sphere.h"
+#include "AABB.h"
 
 class Physical : public Object {
 public:
@@ -11,6 +12,7 @@ public:
   virtual void Reset() override;
   virtual void Update() override;
   virtual void OnCollide(Object& other, const Vector3& push);
+  virtual void OnHit(Object& other, const Vector3& push) override;
 
   void SetPosition(const Vector3& _pos) {
     pos = _pos;
@@ -18,6 +20,11 @@ public:
   }
 
   bool TryPortal(const Portal& portal);
+  AABB HitBounds() const;
+
+  //Bodies that stay at rest long enough stop simulating until something hits them
+  void UpdateSleep();
+  void Wake();
 
   virtual Physical* AsPhysical() override { return this; }
 
@@ -30,5 +37,9 @@ public:
   
   Vector3 prev_pos;
 
+  bool canSleep;
+  bool sleeping;
+  float restTime;
+
   std::vector<Sphere> hitSpheres;
 };
@@ -0,0 +1,30 @@
+#pragma once
+#include "GameHeader.h"
+
+//Forward declarations
+class Input;
+
+class Platform {
+public:
+  Platform() : width(GH_SCREEN_WIDTH), height(GH_SCREEN_HEIGHT) {}
+  virtual ~Platform() {}
+
+  //Create the window and GL context (if any), returns false on failure
+  virtual bool Create(Input& input) = 0;
+
+  //Process pending events, returns false when the application should quit
+  virtual bool PollEvents() = 0;
+  virtual void SwapBuffers() = 0;
+  virtual void ConfineCursor() {}
+
+  //Headless platforms have no GL and step a simulated clock
+  virtual bool HasGL() const = 0;
+  virtual bool IsRealtime() const = 0;
+
+  int Width() const { return width; }
+  int Height() const { return height; }
+
+protected:
+  int width;
+  int height;
+};
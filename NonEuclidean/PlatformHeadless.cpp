@@ -0,0 +1,99 @@
+#include "PlatformHeadless.h"
+#include <GL/glew.h>
+#include <iostream>
+
+PlatformHeadless::PlatformHeadless(int64_t numFrames, bool useGL) :
+  numFrames(numFrames),
+  curFrame(0),
+  useGL(useGL),
+  hasGL(false) {
+#ifdef GH_USE_EGL
+  display = EGL_NO_DISPLAY;
+  surface = EGL_NO_SURFACE;
+  context = EGL_NO_CONTEXT;
+#endif
+}
+
+PlatformHeadless::~PlatformHeadless() {
+#ifdef GH_USE_EGL
+  if (display != EGL_NO_DISPLAY) {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT) { eglDestroyContext(display, context); }
+    if (surface != EGL_NO_SURFACE) { eglDestroySurface(display, surface); }
+    eglTerminate(display);
+  }
+#endif
+}
+
+bool PlatformHeadless::Create(Input& input) {
+  if (useGL && !CreateGLContext()) {
+    std::cerr << "Headless: no offscreen GL context, running simulation only." << std::endl;
+  }
+  return true;
+}
+
+bool PlatformHeadless::PollEvents() {
+  curFrame += 1;
+  return (numFrames <= 0 || curFrame <= numFrames);
+}
+
+void PlatformHeadless::SwapBuffers() {
+  if (hasGL) {
+    //No presentation, but wait for the GPU so frame times are honest
+    glFinish();
+  }
+}
+
+bool PlatformHeadless::CreateGLContext() {
+#ifdef GH_USE_EGL
+  display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+    return false;
+  }
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    return false;
+  }
+
+  //Offscreen pbuffer stands in for the window's back buffer
+  const EGLint configAttribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_DEPTH_SIZE, 24,
+    EGL_STENCIL_SIZE, 8,
+    EGL_NONE
+  };
+  EGLConfig config;
+  EGLint numConfigs = 0;
+  if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+    return false;
+  }
+
+  const EGLint surfaceAttribs[] = {
+    EGL_WIDTH, width,
+    EGL_HEIGHT, height,
+    EGL_NONE
+  };
+  surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+  if (surface == EGL_NO_SURFACE) {
+    return false;
+  }
+
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, nullptr);
+  if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)) {
+    return false;
+  }
+
+  //GLEW must be built with GLEW_EGL to load entry points without GLX
+  if (glewInit() != GLEW_OK) {
+    return false;
+  }
+
+  hasGL = true;
+  return true;
+#else
+  return false;
+#endif
+}
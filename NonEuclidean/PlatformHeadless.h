@@ -0,0 +1,34 @@
+#pragma once
+#include "Platform.h"
+#ifdef GH_USE_EGL
+#include <EGL/egl.h>
+#endif
+
+//Windowless platform for batch runs. The simulation always runs, rendering
+//only happens when built with GH_USE_EGL and an offscreen context was created.
+class PlatformHeadless : public Platform {
+public:
+  PlatformHeadless(int64_t numFrames, bool useGL);
+  virtual ~PlatformHeadless() override;
+
+  virtual bool Create(Input& input) override;
+  virtual bool PollEvents() override;
+  virtual void SwapBuffers() override;
+
+  virtual bool HasGL() const override { return hasGL; }
+  virtual bool IsRealtime() const override { return false; }
+
+private:
+  bool CreateGLContext();
+
+  int64_t numFrames;   // frames to run, 0 runs forever
+  int64_t curFrame;
+  bool useGL;
+  bool hasGL;
+
+#ifdef GH_USE_EGL
+  EGLDisplay display;
+  EGLSurface surface;
+  EGLContext context;
+#endif
+};
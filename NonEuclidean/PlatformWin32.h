@@ -0,0 +1,32 @@
+#pragma once
+#include "Platform.h"
+#include <windows.h>
+
+class PlatformWin32 : public Platform {
+public:
+  PlatformWin32();
+  virtual ~PlatformWin32() override;
+
+  virtual bool Create(Input& input) override;
+  virtual bool PollEvents() override;
+  virtual void SwapBuffers() override;
+  virtual void ConfineCursor() override;
+
+  virtual bool HasGL() const override { return hRC != NULL; }
+  virtual bool IsRealtime() const override { return true; }
+
+  LRESULT WindowProc(HWND hCurWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
+
+private:
+  bool CreateGLWindow();
+  void SetupInputs();
+  void ToggleFullscreen();
+
+  HDC   hDC;           // device context
+  HGLRC hRC;           // opengl context
+  HWND  hWnd;          // window
+  HINSTANCE hInstance; // process id
+
+  bool isFullscreen;   // fullscreen state
+  Input* input;
+};
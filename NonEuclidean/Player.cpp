@@ -1,10 +1,10 @@
 #include "Player.h"
 #include "Input.h"
 #include "GameHeader.h"
-#include <Windows.h>
 #include <iostream>
 
 Player::Player() {
+  canSleep = false;
   Reset();
   hitSpheres.push_back(Sphere(Vector3(0, 0, 0), GH_PLAYER_RADIUS));
   hitSpheres.push_back(Sphere(Vector3(0, GH_PLAYER_RADIUS - GH_PLAYER_HEIGHT, 0), GH_PLAYER_RADIUS));
@@ -25,7 +25,8 @@ void Player::Update() {
   //Update bobbing motion
   float magT = (prev_pos - pos).Mag() / (GH_DT * p_scale);
   if (!onGround) { magT = 0.0f; }
-  bob_mag = bob_mag*(1.0f - GH_BOB_DAMP) + magT*GH_BOB_DAMP;
+  const float bobDamp = GH_STEP_DECAY(GH_BOB_DAMP);
+  bob_mag = bob_mag*(1.0f - bobDamp) + magT*bobDamp;
   if (bob_mag < GH_BOB_MIN) {
     bob_phi = 0.0f;
   } else {
@@ -60,7 +61,7 @@ void Player::Update() {
 
 #if 0
   //Jumping
-  if (onGround && GH_INPUT->key[VK_SPACE]) {
+  if (onGround && GH_INPUT->key[' ']) {
     velocity.y += 2.0f * p_scale;
   }
 #endif
@@ -96,7 +97,7 @@ void Player::Move(float moveF, float moveL) {
   }
 
   //Movement
-  const Matrix4 camToWorld = LocalToWorld() * Matrix4::RotY(cam_ry);
+  const Affine3x4 camToWorld = LocalToWorld() * Affine3x4::RotY(cam_ry);
   velocity += camToWorld.MulDirection(Vector3(-moveL, 0, -moveF)) * (GH_WALK_ACCEL * GH_DT);
 
   //Don't allow non-falling speeds above the player's max speed
@@ -126,12 +127,12 @@ void Player::OnCollide(Object& other, const Vector3& push) {
   friction = cur_friction;
 }
 
-Matrix4 Player::WorldToCam() const {
-  return Matrix4::RotX(-cam_rx) * Matrix4::RotY(-cam_ry) * Matrix4::Trans(-CamOffset()) * WorldToLocal();
+Affine3x4 Player::WorldToCam() const {
+  return Affine3x4::RotX(-cam_rx) * Affine3x4::RotY(-cam_ry) * Affine3x4::Trans(-CamOffset()) * WorldToLocal();
 }
 
-Matrix4 Player::CamToWorld() const {
-  return LocalToWorld() * Matrix4::Trans(CamOffset()) * Matrix4::RotY(cam_ry) * Matrix4::RotX(cam_rx);
+Affine3x4 Player::CamToWorld() const {
+  return LocalToWorld() * Affine3x4::Trans(CamOffset()) * Affine3x4::RotY(cam_ry) * Affine3x4::RotX(cam_rx);
 }
 
 Vector3 Player::CamOffset() const {
@@ -14,8 +14,8 @@ public:
   void Look(float mouseDx, float mouseDy);
   void Move(float moveF, float moveL);
 
-  Matrix4 WorldToCam() const;
-  Matrix4 CamToWorld() const;
+  Affine3x4 WorldToCam() const;
+  Affine3x4 CamToWorld() const;
   Vector3 CamOffset() const;
 
 private:
@@ -19,11 +19,106 @@ void Portal::Draw(const Camera& cam, GLuint curFBO) {
     return;
   }
 
+  //Render portal's view from new camera
+  const Warp* warp;
+  Camera portalCam = PortalCamera(cam, warp);
+
+  //Portals seen straight from the eye match the screen's pixels, the ones
+  //further down lose resolution at each level. The target only holds the
+  //part of the view that the portal covers.
+  const QualitySettings& quality = GH_ENGINE->Quality();
+  const bool fromEye = (GH_REC_LEVEL == GH_ENGINE->RecursionDepth() - 1);
+  const float scale = (fromEye ? 1.0f : GH_FBO_FALLOFF) * quality.portalScale;
+  const float fit = float(GH_FBO_SIZE) / float(GH_MAX(cam.width, cam.height));
+  portalCam.width = GH_MAX(int(cam.width * GH_MIN(scale, fit)), 1);
+  portalCam.height = GH_MAX(int(cam.height * GH_MIN(scale, fit)), 1);
+  int x0, y0, x1, y1;
+  portalCam.PixelBounds(portalCam.scissor, x0, y0, x1, y1);
+  portalCam.viewX = x0;
+  portalCam.viewY = y0;
+
+  //Portals seen straight from the eye keep their own target, so when neither
+  //the view through them nor anything in the scene moved, last frame's view
+  //and everything nested in it can be shown again as is
+  FrameBufferPool& pool = GH_ENGINE->GetFrameBuffers();
+  FrameBuffer& frameBuf = (fromEye ? pool.GetOwned(this, x1 - x0, y1 - y0) : pool.Get(GH_REC_LEVEL - 1, x1 - x0, y1 - y0));
+  const bool reuse = fromEye && !GH_ENGINE->SceneChanged() && frameBuf.Holds(portalCam);
+  if (!reuse) {
+    //Portals nested in a small one barely show but still cost a whole pass
+    //each, so when short on time its view stops a level early
+    const bool shallow = (GH_REC_LEVEL > 1 && portalCam.scissor.Area() < quality.minCoverage);
+    GH_REC_LEVEL -= (shallow ? 1 : 0);
+    frameBuf.Render(portalCam, curFBO, warp->toPortal);
+    GH_REC_LEVEL += (shallow ? 1 : 0);
+    cam.UseViewport();
+  }
+  if (fromEye) {
+    GH_ENGINE->CountPortalView(reuse);
+  }
+
+  //Now we can render the portal texture to the screen
+  const Matrix4 mv = LocalToWorld().ToMatrix4();
+  const Matrix4 mvp = cam.Matrix() * LocalToWorld();
+  shader->Use();
+  frameBuf.Use();
+  shader->SetMVP(mvp.m, mv.m);
+  shader->SetUVRect(float(portalCam.width) / frameBuf.Width(), float(portalCam.height) / frameBuf.Height(),
+                    float(-x0) / frameBuf.Width(), float(-y0) / frameBuf.Height());
+  mesh->Draw();
+}
+
+void Portal::DrawStencil(const Camera& cam, int stencil) {
+  assert(euler.x == 0.0f);
+  assert(euler.z == 0.0f);
+
+  //Draw pink to indicate end of render chain
+  if (GH_REC_LEVEL <= 0) {
+    DrawPink(cam);
+    return;
+  }
+
+  //Mark the visible part of the portal with the next stencil value
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+  DrawPink(cam);
+
+  //Push the depth inside it back to the far plane
+  glStencilFunc(GL_EQUAL, stencil + 1, 0xFF);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+  glDepthMask(GL_TRUE);
+  glDepthFunc(GL_ALWAYS);
+  glDepthRange(1.0, 1.0);
+  DrawPink(cam);
+  glDepthRange(0.0, 1.0);
+  glDepthFunc(GL_LESS);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+  //Render portal's view straight into the marked pixels
+  const Warp* warp;
+  const Camera portalCam = PortalCamera(cam, warp);
+  portalCam.UseViewport();
+  GH_ENGINE->Render(portalCam, 0, warp->toPortal);
+  cam.UseViewport();
+
+  //Unmark it and leave the portal's own depth behind
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthFunc(GL_ALWAYS);
+  glStencilFunc(GL_EQUAL, stencil + 1, 0xFF);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_DECR);
+  DrawPink(cam);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+  glStencilFunc(GL_EQUAL, stencil, 0xFF);
+  glDepthFunc(GL_LESS);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+Camera Portal::PortalCamera(const Camera& cam, const Warp*& warp) const {
   //Find normal relative to camera
   Vector3 normal = Forward();
-  const Vector3 camPos = cam.worldView.Inverse().Translation();
+  const Vector3 camPos = cam.worldView.InverseOrthogonal().Translation();
   const bool frontDirection = (camPos - pos).Dot(normal) > 0;
-  const Warp* warp = (frontDirection ? &front : &back);
+  warp = (frontDirection ? &front : &back);
   if (frontDirection) {
     normal = -normal;
   }
@@ -31,40 +126,61 @@ void Portal::Draw(const Camera& cam, GLuint curFBO) {
   //Extra clipping to prevent artifacts
   const float extra_clip = GH_MIN(GH_ENGINE->NearestPortalDist() * 0.5f, 0.1f);
 
-  //Create new portal camera
+  //Create new portal camera, it can only see through the portal's rectangle
   Camera portalCam = cam;
+  portalCam.scissor = ScreenBounds(cam);
   portalCam.ClipOblique(pos - normal*extra_clip, -normal);
   portalCam.worldView *= warp->delta;
-  portalCam.width = GH_FBO_SIZE;
-  portalCam.height = GH_FBO_SIZE;
-
-  //Render portal's view from new camera
-  frameBuf[GH_REC_LEVEL - 1].Render(portalCam, curFBO, warp->toPortal);
-  cam.UseViewport();
-
-  //Now we can render the portal texture to the screen
-  const Matrix4 mv = LocalToWorld();
-  const Matrix4 mvp = cam.Matrix() * mv;
-  shader->Use();
-  frameBuf[GH_REC_LEVEL - 1].Use();
-  shader->SetMVP(mvp.m, mv.m);
-  mesh->Draw();
+  return portalCam;
 }
 
 void Portal::DrawPink(const Camera& cam) {
-  const Matrix4 mv = LocalToWorld();
-  const Matrix4 mvp = cam.Matrix() * mv;
+  const Matrix4 mv = LocalToWorld().ToMatrix4();
+  const Matrix4 mvp = cam.Matrix() * LocalToWorld();
   errShader->Use();
   errShader->SetMVP(mvp.m, mv.m);
   mesh->Draw();
 }
 
+ScreenRect Portal::ScreenBounds(const Camera& cam) const {
+  //Corners of the portal quad in view space
+  const Affine3x4 localToView = cam.worldView * LocalToWorld();
+  const Vector3 corners[4] = {
+    localToView.MulPoint(Vector3(1, 1, 0)),
+    localToView.MulPoint(Vector3(-1, 1, 0)),
+    localToView.MulPoint(Vector3(-1, -1, 0)),
+    localToView.MulPoint(Vector3(1, -1, 0)),
+  };
+
+  //Cut off the part behind the eye, then bound the projected outline. The
+  //near plane is ignored since oblique clipping moves it, this stays safe.
+  static const float MIN_DEPTH = 1e-5f;
+  ScreenRect rect;
+  for (int i = 0; i < 4; ++i) {
+    const Vector3& a = corners[i];
+    const Vector3& b = corners[(i + 1) % 4];
+    Vector3 outline[2];
+    int numPoints = 0;
+    if (a.z < -MIN_DEPTH) {
+      outline[numPoints++] = a;
+    }
+    if ((a.z < -MIN_DEPTH) != (b.z < -MIN_DEPTH)) {
+      outline[numPoints++] = a + (b - a) * ((-MIN_DEPTH - a.z) / (b.z - a.z));
+    }
+    for (int j = 0; j < numPoints; ++j) {
+      const Vector4 clip = cam.projection * Vector4(outline[j], 1.0f);
+      rect.Expand(clip.x / clip.w, clip.y / clip.w);
+    }
+  }
+  return rect.Intersect(cam.scissor);
+}
+
 Vector3 Portal::GetBump(const Vector3& a) const {
   const Vector3 n = Forward();
   return n * ((a - pos).Dot(n) > 0 ? 1.0f : -1.0f);
 }
 
-const Portal::Warp* Portal::Intersects(const Vector3& a, const Vector3& b, const Vector3& bump) const {
+const Portal::Warp* Portal::Intersects(const Vector3& a, const Vector3& b, const Vector3& bump, float* t) const {
   const Vector3 n = Forward();
   const Vector3 p = pos + bump;
   const float da = n.Dot(a - p);
@@ -72,22 +188,25 @@ const Portal::Warp* Portal::Intersects(const Vector3& a, const Vector3& b, const
   if (da * db > 0.0f) {
     return nullptr;
   }
-  const Matrix4 m = LocalToWorld();
+  const Affine3x4& m = LocalToWorld();
   const Vector3 d = a + (b - a) * (da / (da - db)) - p;
-  const Vector3 x = (m * Vector4(1, 0, 0, 0)).XYZ();
+  const Vector3 x = m.XAxis();
   if (std::abs(d.Dot(x)) >= x.Dot(x)) {
     return nullptr;
   }
-  const Vector3 y = (m * Vector4(0, 1, 0, 0)).XYZ();
+  const Vector3 y = m.YAxis();
   if (std::abs(d.Dot(y)) >= y.Dot(y)) {
     return nullptr;
   }
+  if (t) {
+    *t = da / (da - db);
+  }
   return (da > 0.0f ? &front : &back);
 }
 
 float Portal::DistTo(const Vector3& pt) const {
   //Get world delta
-  const Matrix4 localToWorld = LocalToWorld();
+  const Affine3x4& localToWorld = LocalToWorld();
   const Vector3 v = pt - localToWorld.Translation();
 
   //Get axes
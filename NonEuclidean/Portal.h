@@ -1,7 +1,6 @@
 #pragma once
 #include "GameHeader.h"
 #include "Object.h"
-#include "FrameBuffer.h"
 #include "Mesh.h"
 #include "Resources.h"
 #include "Shader.h"
@@ -16,8 +15,8 @@ public:
       deltaInv.MakeIdentity();
     }
 
-    Matrix4 delta;
-    Matrix4 deltaInv;
+    Affine3x4 delta;
+    Affine3x4 deltaInv;
     const Portal* fromPortal;
     const Portal* toPortal;
   };
@@ -28,8 +27,15 @@ public:
   virtual void Draw(const Camera& cam, GLuint curFBO) override;
   void DrawPink(const Camera& cam);
 
+  //Draws the view through the portal into the current framebuffer, limited
+  //to pixels where the stencil is at the given nesting level
+  void DrawStencil(const Camera& cam, int stencil);
+
+  //Part of the camera's visible rectangle the portal covers, empty if none
+  ScreenRect ScreenBounds(const Camera& cam) const;
+
   Vector3 GetBump(const Vector3& a) const;
-  const Warp* Intersects(const Vector3& a, const Vector3& b, const Vector3& bump) const;
+  const Warp* Intersects(const Vector3& a, const Vector3& b, const Vector3& bump, float* t=nullptr) const;
   float DistTo(const Vector3& pt) const;
 
   static void Connect(std::shared_ptr<Portal>& a, std::shared_ptr<Portal>& b);
@@ -39,7 +45,8 @@ public:
   Warp back;
 
 private:
+  Camera PortalCamera(const Camera& cam, const Warp*& warp) const;
+
   std::shared_ptr<Shader> errShader;
-  FrameBuffer frameBuf[GH_MAX_RECURSION <= 1 ? 1 : GH_MAX_RECURSION - 1];
 };
 typedef std::vector<std::shared_ptr<Portal>> PPortalVec;
\ No newline at end of file
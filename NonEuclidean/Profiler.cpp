@@ -0,0 +1,81 @@
+#include "Profiler.h"
+#include "GameHeader.h"
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Profiler::recording(false);
+int64_t Profiler::startTicks = 0;
+
+//Only its own thread writes to a ring, the head is published last so a
+//reader never sees an event before it is complete
+struct ProfileRing {
+  ProfileRing() : events(GH_PROFILE_EVENTS), head(0) {}
+  std::vector<ProfileEvent> events;
+  std::atomic<uint64_t> head;  // events written so far
+};
+
+//Rings outlive their threads, the job system can be rebuilt at any time
+static std::mutex ringsMutex;
+static std::vector<std::unique_ptr<ProfileRing>> rings;
+static thread_local ProfileRing* threadRing = nullptr;
+
+void Profiler::Start() {
+  startTicks = Timer::QueryTicks();
+  recording.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::Stop() {
+  recording.store(false, std::memory_order_relaxed);
+}
+
+void Profiler::Record(const ProfileEvent& event) {
+  ProfileRing* ring = threadRing;
+  if (!ring) {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    rings.emplace_back(new ProfileRing);
+    ring = threadRing = rings.back().get();
+  }
+  const uint64_t head = ring->head.load(std::memory_order_relaxed);
+  ring->events[head % GH_PROFILE_EVENTS] = event;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool Profiler::WriteTrace(const char* fname) {
+  FILE* fout = std::fopen(fname, "w");
+  if (!fout) {
+    return false;
+  }
+
+  //Complete events nest by their times, so no explicit hierarchy is needed
+  std::lock_guard<std::mutex> lock(ringsMutex);
+  const double usPerTick = 1e6 / double(Timer::QueryFrequency());
+  std::fprintf(fout, "{\"traceEvents\":[\n");
+  const char* separator = "";
+  for (size_t t = 0; t < rings.size(); ++t) {
+    const ProfileRing& ring = *rings[t];
+    std::fprintf(fout, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}",
+      separator, int(t), (&ring == threadRing ? "Main" : "Worker"), int(t));
+    separator = ",\n";
+
+    //Older events were overwritten, the ring only keeps the latest ones
+    const uint64_t head = ring.head.load(std::memory_order_acquire);
+    const uint64_t first = (head > uint64_t(GH_PROFILE_EVENTS) ? head - GH_PROFILE_EVENTS : 0);
+    for (uint64_t i = first; i < head; ++i) {
+      const ProfileEvent& event = ring.events[i % GH_PROFILE_EVENTS];
+      if (event.begin < startTicks) {
+        continue;
+      }
+      std::fprintf(fout, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+        separator, event.name, int(t), double(event.begin - startTicks) * usPerTick,
+        double(event.end - event.begin) * usPerTick);
+      if (event.argName) {
+        std::fprintf(fout, ",\"args\":{\"%s\":%d}", event.argName, event.arg);
+      }
+      std::fprintf(fout, "}");
+    }
+  }
+  std::fprintf(fout, "\n]}\n");
+  return std::fclose(fout) == 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "Timer.h"
+#include <atomic>
+#include <stdint.h>
+
+//One finished zone. Names and arg names must be string literals.
+struct ProfileEvent {
+  const char* name;
+  const char* argName;  // null if the zone has no argument
+  int arg;
+  int64_t begin;        // ticks
+  int64_t end;
+};
+
+//Records named zones into a ring of the last GH_PROFILE_EVENTS events per
+//thread, so threads never wait on each other. A thread's ring is registered
+//the first time it records, after that writing an event is a store and an
+//index bump. Traces can only be written while no other thread is inside a
+//zone, between frames is always safe.
+class Profiler {
+public:
+  //Zones only cost a flag check while not recording
+  static void Start();
+  static void Stop();
+  static bool Recording() { return recording.load(std::memory_order_relaxed); }
+
+  static void Record(const ProfileEvent& event);
+
+  //Chrome trace event JSON of everything since Start, for chrome://tracing
+  //or Perfetto. Returns false if the file can't be written.
+  static bool WriteTrace(const char* fname);
+
+private:
+  static std::atomic<bool> recording;
+  static int64_t startTicks;
+};
+
+//Times its own scope as a zone. Next ends the zone and starts another in the
+//same scope, for functions made of several phases.
+class ProfileZone {
+public:
+  explicit ProfileZone(const char* name, const char* argName = nullptr, int arg = 0) {
+    Begin(name, argName, arg);
+  }
+  ~ProfileZone() {
+    End();
+  }
+
+  void Next(const char* name, const char* argName = nullptr, int arg = 0) {
+    End();
+    Begin(name, argName, arg);
+  }
+
+private:
+  ProfileZone(const ProfileZone&) = delete;
+  ProfileZone& operator=(const ProfileZone&) = delete;
+
+  void Begin(const char* name, const char* argName, int arg) {
+    event.name = name;
+    event.argName = argName;
+    event.arg = arg;
+    event.begin = (Profiler::Recording() ? Timer::QueryTicks() : 0);
+  }
+  void End() {
+    if (event.begin != 0) {
+      event.end = Timer::QueryTicks();
+      Profiler::Record(event);
+    }
+  }
+
+  ProfileEvent event;
+};
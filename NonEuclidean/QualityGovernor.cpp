@@ -0,0 +1,144 @@
+#include "QualityGovernor.h"
+
+//Cheapest last. Portal resolution is the least visible, so it goes first and
+//small portals follow. Cutting recursion shows the pink end of the chain.
+//A scaled main view comes last: drawing it offscreen and stretching it over
+//the window measured slower than a full size view on software GL, even at
+//0.85 scale, so it's only worth it where fill rate is really short.
+static const QualitySettings STEPS[] = {
+  { GH_MAX_RECURSION, 1.0f, 1.0f, 0.0f },
+  { GH_MAX_RECURSION, 1.0f, 0.75f, 0.0f },
+  { GH_MAX_RECURSION, 1.0f, 0.75f, 0.02f },
+  { GH_MAX_RECURSION, 1.0f, 0.6f, 0.05f },
+  { GH_MIN(3, GH_MAX_RECURSION), 1.0f, 0.6f, 0.05f },
+  { GH_MIN(3, GH_MAX_RECURSION), 1.0f, 0.5f, 0.1f },
+  { GH_MIN(2, GH_MAX_RECURSION), 1.0f, 0.5f, 0.1f },
+  { GH_MIN(2, GH_MAX_RECURSION), 0.7f, 0.5f, 0.1f },
+  { 1, 0.5f, 0.5f, 0.2f },
+};
+static const int NUM_STEPS = int(sizeof(STEPS) / sizeof(STEPS[0]));
+
+QualityGovernor::QualityGovernor() : budget(0.0f), step(0), lastStep(0), changed(false), settle(0),
+  hold(0), stepFrom(0.0f), cpuSmoothed(0.0f), gpuSmoothed(0.0f), cpuTime(0.0f), gpuTime(0.0f),
+  gpuTimed(false), frame(0) {
+  for (int i = 0; i < GH_FRAMES_IN_FLIGHT; ++i) {
+    queries[i] = 0;
+    pending[i] = false;
+  }
+}
+
+QualityGovernor::~QualityGovernor() {
+  Release();
+}
+
+void QualityGovernor::SetBudget(float seconds) {
+  budget = GH_MAX(seconds, 0.0f);
+  if (budget == 0.0f) {
+    step = 0;
+  }
+  settle = GH_BUDGET_SETTLE;
+  hold = 0;
+  stepFrom = 0.0f;
+  cpuSmoothed = gpuSmoothed = 0.0f;
+}
+
+void QualityGovernor::BeginFrame() {
+  changed = (step != lastStep);
+  lastStep = step;
+  timer.Start();
+
+  //The query that was started GH_FRAMES_IN_FLIGHT frames ago is reused, and
+  //it's only read if the GPU is done with it
+  if (!GH_HAS_GL || !GLEW_VERSION_3_3) {
+    return;
+  }
+  if (queries[0] == 0) {
+    glGenQueries(GH_FRAMES_IN_FLIGHT, queries);
+  }
+  if (pending[frame]) {
+    GLint available = 0;
+    glGetQueryObjectiv(queries[frame], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      //Some drivers return garbage for a query's first use
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(queries[frame], GL_QUERY_RESULT, &ns);
+      if (ns < 1000000000) {
+        gpuTime = float(double(ns) * 1e-9);
+        gpuTimed = true;
+      }
+    }
+  }
+  glBeginQuery(GL_TIME_ELAPSED, queries[frame]);
+}
+
+void QualityGovernor::EndFrame() {
+  cpuTime = timer.Stop();
+  if (queries[0] != 0) {
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[frame] = true;
+    frame = (frame + 1) % GH_FRAMES_IN_FLIGHT;
+  }
+  if (budget > 0.0f) {
+    Adjust();
+  }
+}
+
+const QualitySettings& QualityGovernor::Settings() const {
+  return STEPS[step];
+}
+
+void QualityGovernor::Adjust() {
+  //Only frames rendered after the last step count, and GPU times lag a few
+  //frames behind, so the first ones are left out of the average
+  settle = GH_MAX(settle - 1, 0);
+  hold = GH_MAX(hold - 1, 0);
+  if (settle < GH_BUDGET_SETTLE - GH_FRAMES_IN_FLIGHT) {
+    cpuSmoothed = (cpuSmoothed == 0.0f ? cpuTime : cpuSmoothed + (cpuTime - cpuSmoothed) * GH_BUDGET_SMOOTH);
+    gpuSmoothed = (gpuSmoothed == 0.0f ? gpuTime : gpuSmoothed + (gpuTime - gpuSmoothed) * GH_BUDGET_SMOOTH);
+  }
+  if (settle > 0) {
+    return;
+  }
+  const float frameTime = GH_MAX(cpuSmoothed, gpuSmoothed);
+
+  //Take back a step down that didn't pay for itself and stay put for a while,
+  //the rungs below are likely no better
+  if (stepFrom > 0.0f) {
+    const bool helped = (frameTime < stepFrom * GH_BUDGET_GAIN);
+    stepFrom = 0.0f;
+    if (!helped) {
+      hold = GH_BUDGET_RETRY;
+      MoveTo(step - 1);
+      return;
+    }
+  }
+
+  //Without GPU times there's no telling what's slow, so the check above
+  //has to catch steps that don't help
+  const bool cpuBound = gpuTimed && cpuSmoothed >= gpuSmoothed;
+  if (frameTime > budget && !cpuBound && hold == 0 && step + 1 < NUM_STEPS) {
+    stepFrom = frameTime;
+    MoveTo(step + 1);
+  } else if (frameTime < budget * GH_BUDGET_HEADROOM && step > 0) {
+    MoveTo(step - 1);
+  }
+}
+
+void QualityGovernor::MoveTo(int next) {
+  step = next;
+  settle = GH_BUDGET_SETTLE;
+  cpuSmoothed = gpuSmoothed = 0.0f;
+}
+
+void QualityGovernor::Release() {
+  if (queries[0] != 0) {
+    glDeleteQueries(GH_FRAMES_IN_FLIGHT, queries);
+  }
+  for (int i = 0; i < GH_FRAMES_IN_FLIGHT; ++i) {
+    queries[i] = 0;
+    pending[i] = false;
+  }
+  frame = 0;
+  gpuTime = 0.0f;
+  gpuTimed = false;
+}
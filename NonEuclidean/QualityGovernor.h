@@ -0,0 +1,70 @@
+#pragma once
+#include "GameHeader.h"
+#include "Timer.h"
+#include <GL/glew.h>
+
+//How much of the scene gets rendered in a frame
+struct QualitySettings {
+  int recursion;      // levels of portals below the main view
+  float viewScale;    // main view resolution
+  float portalScale;  // portal view resolution, on top of GH_FBO_FALLOFF
+  float minCoverage;  // portals covering less of the screen stop a level early
+};
+
+//Picks the quality of each frame so frame time stays within a budget. CPU
+//time is what rendering takes to submit, GPU time comes from timer queries
+//that are read a few frames late so nothing waits on them. Over budget it
+//steps down a fixed ladder and steps back up once there is enough headroom.
+//A step down that doesn't make frames faster is taken back, and nothing is
+//given up while the CPU is what's slow, since every step mostly saves GPU
+//work. Without a budget every frame is rendered at full quality.
+class QualityGovernor {
+public:
+  QualityGovernor();
+  ~QualityGovernor();
+
+  //Seconds per frame, zero turns the governor off
+  void SetBudget(float seconds);
+  float Budget() const { return budget; }
+
+  //Around everything that renders a frame, BeginFrame picks its settings
+  void BeginFrame();
+  void EndFrame();
+
+  const QualitySettings& Settings() const;
+  //Whether this frame's settings differ from the last frame's
+  bool Changed() const { return changed; }
+
+  //Seconds, GPU time is the latest that came back and zero without queries
+  float CpuTime() const { return cpuTime; }
+  float GpuTime() const { return gpuTime; }
+
+  void Release();
+
+private:
+  QualityGovernor(const QualityGovernor&) = delete;
+  QualityGovernor& operator=(const QualityGovernor&) = delete;
+
+  void Adjust();
+  void MoveTo(int next);
+
+  float budget;
+  int step;          // rung of the ladder, zero is full quality
+  int lastStep;
+  bool changed;
+  int settle;        // frames left before the next step
+  int hold;          // frames left before stepping down is tried again
+  float stepFrom;    // frame time before the last step down, zero once judged
+
+  //Times averaged since the last step, zero if none yet
+  float cpuSmoothed;
+  float gpuSmoothed;
+
+  Timer timer;
+  float cpuTime;
+  float gpuTime;
+  bool gpuTimed;     // some query came back
+  GLuint queries[GH_FRAMES_IN_FLIGHT];
+  bool pending[GH_FRAMES_IN_FLIGHT];
+  int frame;
+};
@@ -0,0 +1,90 @@
+#include "Raycaster.h"
+#include "Mesh.h"
+
+Raycaster::Raycaster(const Broadphase& broadphase, const PObjectVec& objs, const PPortalVec& portals) :
+  broadphase(broadphase),
+  objs(objs),
+  portals(portals) {
+}
+
+bool Raycaster::Ray(const Vector3& from, const Vector3& dir, float maxDist, Hit& hit) {
+  return Cast(from, dir, maxDist, 0.0f, hit);
+}
+
+bool Raycaster::Sphere(const Vector3& from, const Vector3& dir, float maxDist, float radius, Hit& hit) {
+  return Cast(from, dir, maxDist, radius, hit);
+}
+
+bool Raycaster::Cast(const Vector3& from, const Vector3& dir, float maxDist, float radius, Hit& hit) {
+  Vector3 a = from;
+  Vector3 d = dir.Normalized();
+  float remaining = maxDist;
+  float r = radius;
+  const Portal* exitPortal = nullptr;
+  hit.dist = 0.0f;
+  hit.warp.MakeIdentity();
+  hit.scale = 1.0f;
+  hit.numPortals = 0;
+
+  //Each pass covers the cast up to the next portal it goes through
+  for (int pass = 0; pass <= GH_MAX_PORTALS; ++pass) {
+    const Vector3 delta = d * remaining;
+
+    //Closest portal along the way, ignoring the one just came out of
+    const Portal::Warp* warp = nullptr;
+    float tPortal = 1.0f;
+    for (size_t p = 0; p < portals.size(); ++p) {
+      float t;
+      if (portals[p].get() == exitPortal) { continue; }
+      const Portal::Warp* w = portals[p]->Intersects(a, a + delta, Vector3(0.0f), &t);
+      if (w && t < tPortal) {
+        tPortal = t;
+        warp = w;
+      }
+    }
+
+    //Anything hit before reaching the portal ends the cast
+    float tHit;
+    if (CastSegment(a, delta * tPortal, r, tHit, hit)) {
+      hit.dist += remaining * tPortal * tHit / hit.scale;
+      hit.point = a + delta * (tPortal * tHit);
+      return true;
+    }
+    if (!warp) {
+      return false;
+    }
+
+    //Carry on from the other side, same as Physical::TryPortal
+    const float s = warp->deltaInv.XAxis().Mag();
+    hit.dist += remaining * tPortal / hit.scale;
+    a = warp->deltaInv.MulPoint(a + delta * tPortal);
+    d = warp->deltaInv.MulDirection(d) / s;
+    remaining *= (1.0f - tPortal) * s;
+    r *= s;
+    hit.warp = warp->deltaInv * hit.warp;
+    hit.scale *= s;
+    hit.numPortals += 1;
+    exitPortal = warp->toPortal;
+  }
+  return false;
+}
+
+bool Raycaster::CastSegment(const Vector3& a, const Vector3& delta, float radius, float& t, Hit& hit) {
+  broadphase.QuerySegment(a, a + delta, radius, candidates, scratch);
+  bool found = false;
+  t = 1.0f;
+  for (size_t k = 0; k < candidates.size(); ++k) {
+    float tc;
+    Vector3 normal;
+    const Object& obj = *objs[candidates[k].obj];
+    const Collider& collider = obj.mesh->colliders[candidates[k].collider];
+    if (collider.Cast(obj.LocalToWorld(), a, delta, radius, tc, normal) && (!found || tc < t)) {
+      t = tc;
+      hit.obj = candidates[k].obj;
+      hit.collider = candidates[k].collider;
+      hit.normal = normal;
+      found = true;
+    }
+  }
+  return found;
+}
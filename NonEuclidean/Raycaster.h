@@ -0,0 +1,38 @@
+#pragma once
+#include "GameHeader.h"
+#include "Broadphase.h"
+#include "Object.h"
+#include "Portal.h"
+#include <vector>
+
+//Ray and sphere casts against the scene's colliders that follow portals.
+//Each thread that casts needs its own Raycaster for the scratch space.
+class Raycaster {
+public:
+  struct Hit {
+    uint32_t obj;        // index into the scene's object list
+    uint32_t collider;   // index into the object's mesh colliders
+    float dist;          // distance travelled, in the units of the cast's start
+    Vector3 point;       // center of the ray or sphere when it hit
+    Vector3 normal;      // surface normal facing the cast
+    Affine3x4 warp;      // from the cast's start space to where the hit is
+    float scale;         // size change picked up from portals
+    int numPortals;      // portals passed through before the hit
+  };
+
+  Raycaster(const Broadphase& broadphase, const PObjectVec& objs, const PPortalVec& portals);
+
+  //Returns true and fills in hit if anything is closer than maxDist
+  bool Ray(const Vector3& from, const Vector3& dir, float maxDist, Hit& hit);
+  bool Sphere(const Vector3& from, const Vector3& dir, float maxDist, float radius, Hit& hit);
+
+private:
+  bool Cast(const Vector3& from, const Vector3& dir, float maxDist, float radius, Hit& hit);
+  bool CastSegment(const Vector3& a, const Vector3& delta, float radius, float& t, Hit& hit);
+
+  const Broadphase& broadphase;
+  const PObjectVec& objs;
+  const PPortalVec& portals;
+  std::vector<Broadphase::ColliderRef> candidates;
+  std::vector<int> scratch;
+};
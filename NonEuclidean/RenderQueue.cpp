@@ -0,0 +1,136 @@
+#include "RenderQueue.h"
+#include "Mesh.h"
+#include "Shader.h"
+#include "Texture.h"
+#include <algorithm>
+
+GLuint RenderQueue::indirectBuffer = 0;
+
+void RenderQueue::Add(Shader* shader, Texture* texture, Mesh* mesh, uint32_t transform, float depth) {
+  Item item;
+  item.shader = shader;
+  item.texture = texture;
+  item.mesh = mesh;
+  item.transform = transform;
+  item.depth = depth;
+  items.push_back(item);
+}
+
+void RenderQueue::Flush(const TransformBuffer& transforms) {
+  //Sort indices rather than the items. Transforms go last so runs of them
+  //end up next to each other.
+  order.resize(items.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = (uint32_t)i;
+  }
+  std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    const Item& ia = items[a];
+    const Item& ib = items[b];
+    if (ia.shader != ib.shader) { return ia.shader < ib.shader; }
+    if (ia.texture != ib.texture) { return ia.texture < ib.texture; }
+    if (ia.mesh != ib.mesh) { return ia.mesh < ib.mesh; }
+    return ia.transform < ib.transform;
+  });
+
+  //Split into groups of matching state. Culled objects leave gaps in the
+  //transforms, so a group can need more than one instance range.
+  groups.clear();
+  ranges.clear();
+  size_t begin = 0;
+  while (begin < order.size()) {
+    const Item& first = items[order[begin]];
+    Group group;
+    group.begin = begin;
+    group.end = begin + 1;
+    group.firstRange = ranges.size();
+    while (group.end < order.size() && items[order[group.end]].shader == first.shader &&
+           items[order[group.end]].texture == first.texture && items[order[group.end]].mesh == first.mesh) {
+      group.end += 1;
+    }
+    for (size_t i = group.begin; i < group.end; ++i) {
+      const Item& item = items[order[i]];
+      if (ranges.size() > group.firstRange && ranges.back().transform + ranges.back().count == item.transform) {
+        ranges.back().count += 1;
+        ranges.back().nearest = GH_MIN(ranges.back().nearest, item.depth);
+        continue;
+      }
+      Range range;
+      range.transform = item.transform;
+      range.count = 1;
+      range.nearest = item.depth;
+      ranges.push_back(range);
+    }
+    group.numRanges = ranges.size() - group.firstRange;
+    std::sort(ranges.begin() + group.firstRange, ranges.end(), [](const Range& a, const Range& b) {
+      return a.nearest < b.nearest;
+    });
+    groups.push_back(group);
+    begin = group.end;
+  }
+
+  //Every group's commands go up at once
+  const bool useIndirect = (GLEW_VERSION_4_3 != 0);
+  if (useIndirect && !ranges.empty()) {
+    commands.resize(ranges.size());
+    for (size_t i = 0; i < groups.size(); ++i) {
+      const GLuint count = GLuint(items[order[groups[i].begin]].mesh->NumIndices());
+      for (size_t r = groups[i].firstRange; r < groups[i].firstRange + groups[i].numRanges; ++r) {
+        DrawElementsCommand& cmd = commands[r];
+        cmd.count = count;
+        cmd.instanceCount = GLuint(ranges[r].count);
+        cmd.firstIndex = 0;
+        cmd.baseVertex = 0;
+        cmd.baseInstance = ranges[r].transform;
+      }
+    }
+    if (indirectBuffer == 0) {
+      glGenBuffers(1, &indirectBuffer);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsCommand), commands.data(), GL_STREAM_DRAW);
+  }
+
+  //Draw each group
+  const bool useInstancing = (GLEW_VERSION_3_3 != 0);
+  for (size_t i = 0; i < groups.size(); ++i) {
+    const Group& group = groups[i];
+    const Item& first = items[order[group.begin]];
+    first.shader->Use();
+    if (first.texture) {
+      first.texture->Use();
+    }
+    if (useIndirect) {
+      first.mesh->DrawIndirect(transforms.Buffer(), group.firstRange * sizeof(DrawElementsCommand), GLsizei(group.numRanges));
+    } else if (useInstancing) {
+      for (size_t r = group.firstRange; r < group.firstRange + group.numRanges; ++r) {
+        first.mesh->DrawInstanced(transforms.Buffer(), ranges[r].transform * Mesh::INSTANCE_STRIDE, ranges[r].count);
+      }
+    } else {
+      DrawGroup(transforms, group.begin, group.end);
+    }
+  }
+  items.clear();
+}
+
+void RenderQueue::DrawGroup(const TransformBuffer& transforms, size_t begin, size_t end) {
+  //One at a time, with the transform rows as constant attributes, so
+  //there are no ranges to keep together and the draws just go nearest first
+  std::sort(order.begin() + begin, order.begin() + end, [this](uint32_t a, uint32_t b) {
+    return items[a].depth < items[b].depth;
+  });
+  for (size_t i = begin; i < end; ++i) {
+    const Item& item = items[order[i]];
+    const float* m = transforms.Staged(item.transform);
+    for (int r = 0; r < Mesh::NUM_INSTANCE_ATTRIBS; ++r) {
+      glVertexAttrib4fv(Mesh::INSTANCE_ATTRIB + r, m + 4 * r);
+    }
+    item.mesh->Draw();
+  }
+}
+
+void RenderQueue::Release() {
+  if (indirectBuffer) {
+    glDeleteBuffers(1, &indirectBuffer);
+    indirectBuffer = 0;
+  }
+}
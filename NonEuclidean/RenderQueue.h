@@ -0,0 +1,67 @@
+#pragma once
+#include "GLState.h"
+#include "TransformBuffer.h"
+#include "Vector.h"
+#include <GL/glew.h>
+#include <vector>
+
+//Forward declarations
+class Mesh;
+class Shader;
+class Texture;
+
+//Draws collected for one camera. They are sorted so that draws sharing a
+//shader, texture and mesh go together. Draws refer to a transform already in
+//the frame's TransformBuffer, and a run of them with consecutive transforms
+//is a single instance range reading straight from it. Within a group the
+//ranges go nearest first, by their nearest draw, so early-z rejects more.
+//With GL 4.3 each group is one multi-draw with a command per range, with
+//GL 3.3 each range is one instanced draw.
+class RenderQueue {
+public:
+  //Depth is the distance in front of the camera, used to draw near to far
+  void Add(Shader* shader, Texture* texture, Mesh* mesh, uint32_t transform, float depth);
+
+  //Sorts and draws everything added with the current camera, then empties the queue
+  void Flush(const TransformBuffer& transforms);
+
+  size_t Size() const { return items.size(); }
+
+  //Frees the indirect buffer shared by all queues
+  static void Release();
+
+private:
+  struct Item {
+    Shader* shader;
+    Texture* texture;
+    Mesh* mesh;
+    uint32_t transform;
+    float depth;
+  };
+
+  //Draws with consecutive transforms, drawn as one set of instances
+  struct Range {
+    uint32_t transform;
+    GLsizei count;
+    float nearest;
+  };
+
+  //Draws sharing all state, and the instance ranges they were split into
+  struct Group {
+    size_t begin;
+    size_t end;
+    size_t firstRange;
+    size_t numRanges;
+  };
+
+  void DrawGroup(const TransformBuffer& transforms, size_t begin, size_t end);
+
+  std::vector<Item> items;
+  std::vector<uint32_t> order;
+  std::vector<Group> groups;
+  std::vector<Range> ranges;
+  std::vector<DrawElementsCommand> commands;  // one per range with GL 4.3
+
+  //Queues flush one at a time, so they can all upload to the same buffer
+  static GLuint indirectBuffer;
+};
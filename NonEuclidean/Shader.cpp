@@ -1,8 +1,19 @@
 #include "Shader.h"
+#include "GameHeader.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include "TransformBuffer.h"
 #include <fstream>
 #include <sstream>
 
-Shader::Shader(const char* name) {
+Shader::Shader(const char* name) : vertId(0), fragId(0), progId(0), mvpId(0), mvId(0), uvRectId(0), instanced(false) {
+  ProfileZone zone("Load shader");
+
+  //Nothing to compile without a GL context
+  if (!GH_HAS_GL) {
+    return;
+  }
+
   //Get the file paths
   const std::string vert = "Shaders/" + std::string(name) + ".vert";
   const std::string frag = "Shaders/" + std::string(name) + ".frag";
@@ -17,8 +28,10 @@ Shader::Shader(const char* name) {
   glAttachShader(progId, fragId);
 
   //Bind variables
+  GLuint location = 0;
   for (size_t i = 0; i < attribs.size(); ++i) {
-    glBindAttribLocation(progId, (GLuint)i, attribs[i].c_str());
+    glBindAttribLocation(progId, location, attribs[i].c_str());
+    location += attribSlots[i];
   }
 
   //Link the program
@@ -45,18 +58,30 @@ Shader::Shader(const char* name) {
   //Get global variable locations
   mvpId = glGetUniformLocation(progId, "mvp");
   mvId = glGetUniformLocation(progId, "mv");
+  uvRectId = glGetUniformLocation(progId, "uvRect");
+  instanced = (glGetAttribLocation(progId, "in_model0") >= 0);
+
+  //Every view's camera is in the same uniform block binding
+  const GLuint cameraBlock = glGetUniformBlockIndex(progId, "Camera");
+  if (cameraBlock != GL_INVALID_INDEX) {
+    glUniformBlockBinding(progId, cameraBlock, TransformBuffer::CAMERA_BLOCK);
+  }
 }
 
 Shader::~Shader() {
+  if (!GH_HAS_GL) {
+    return;
+  }
   glDetachShader(progId, vertId);
   glDetachShader(progId, fragId);
   glDeleteProgram(progId);
   glDeleteShader(vertId);
   glDeleteShader(fragId);
+  GLState::Invalidate();
 }
 
 void Shader::Use() {
-  glUseProgram(progId);
+  GLState::UseProgram(progId);
 }
 
 GLuint Shader::LoadShader(const char* fname, GLenum type) {
@@ -100,6 +125,8 @@ GLuint Shader::LoadShader(const char* fname, GLenum type) {
       size_t start_ix = ix;
       while (str[--start_ix] != ' ');
       attribs.push_back(str.substr(start_ix + 1, ix - start_ix - 1));
+      //Matrices take up a location per column
+      attribSlots.push_back(str.compare(start_ix - 4, 4, "mat4") == 0 ? 4 : 1);
     }
   }
 
@@ -111,3 +138,7 @@ void Shader::SetMVP(const float* mvp, const float* mv) {
   if (mvp) glUniformMatrix4fv(mvpId, 1, GL_TRUE, mvp);
   if (mv) glUniformMatrix4fv(mvId, 1, GL_TRUE, mv);
 }
+
+void Shader::SetUVRect(float scaleX, float scaleY, float offsetX, float offsetY) {
+  glUniform4f(uvRectId, scaleX, scaleY, offsetX, offsetY);
+}
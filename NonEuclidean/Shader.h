@@ -10,14 +10,23 @@ public:
 
   void Use();
   void SetMVP(const float* mvp, const float* mv);
+  void SetUVRect(float scaleX, float scaleY, float offsetX, float offsetY);
+
+  //Takes its transform per instance as the in_model0-2 attributes, declared
+  //right after the mesh's own inputs, and its camera from the Camera block
+  //instead of mvp and mv uniforms
+  bool IsInstanced() const { return instanced; }
 
 private:
   GLuint LoadShader(const char* fname, GLenum type);
 
   std::vector<std::string> attribs;
+  std::vector<GLuint> attribSlots;
   GLuint vertId;
   GLuint fragId;
   GLuint progId;
   GLuint mvpId;
   GLuint mvId;
+  GLuint uvRectId;
+  bool instanced;
 };
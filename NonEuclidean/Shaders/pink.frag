@@ -5,8 +5,8 @@ precision highp float;
 uniform sampler2D tex;
 
 //Outputs
-out vec4 gl_FragColor;
+out vec4 out_color;
 
 void main(void) {
-	gl_FragColor = vec4(1.0, 0.0, 1.0, 1.0);
+	out_color = vec4(1.0, 0.0, 1.0, 1.0);
 }
@@ -3,13 +3,14 @@ precision highp float;
 
 //Inputs
 uniform sampler2D tex;
+uniform vec4 uvRect;
 in vec4 ex_uv;
 
 //Outputs
-out vec4 gl_FragColor;
+out vec4 out_color;
 
 void main(void) {
 	vec2 uv = (ex_uv.xy / ex_uv.w);
-	uv = uv*0.5 + 0.5;
-	gl_FragColor = vec4(texture2D(tex, uv).rgb, 1.0);
+	uv = (uv*0.5 + 0.5)*uvRect.xy + uvRect.zw;
+	out_color = vec4(texture(tex, uv).rgb, 1.0);
 }
@@ -12,7 +12,8 @@ in vec2 in_uv;
 out vec3 ex_normal;
 
 void main(void) {
-	gl_Position = vec4(in_pos.xy, 0.0, 1.0);
-	vec3 eye_normal = normalize((mvp * gl_Position).xyz);
+	//Sits on the far plane so it only fills what nothing else covered
+	vec3 eye_normal = normalize((mvp * vec4(in_pos.xy, 0.0, 1.0)).xyz);
+	gl_Position = vec4(in_pos.xy, 1.0, 1.0);
 	ex_normal = normalize((mv * vec4(eye_normal, 0.0)).xyz);
 }
@@ -6,12 +6,12 @@ precision highp float;
 //Inputs
 uniform sampler2D tex;
 in vec2 ex_uv;
-in vec3 ex_normal;
+flat in vec3 ex_normal;
 
 //Outputs
-out vec4 gl_FragColor;
+out vec4 out_color;
 
 void main(void) {
 	float s = dot(ex_normal, LIGHT)*0.5 + 0.5;
-	gl_FragColor = vec4(texture(tex, ex_uv).rgb * s, 1.0);
+	out_color = vec4(texture(tex, ex_uv).rgb * s, 1.0);
 }
@@ -1,20 +1,28 @@
 #version 150
 
 //Globals
-uniform mat4 mvp;
-uniform mat4 mv;
+layout(std140) uniform Camera {
+	mat4 viewProj;
+};
 
 //Inputs
 in vec3 in_pos;
 in vec3 in_uv;
 in vec3 in_normal;
+in vec4 in_model0;
+in vec4 in_model1;
+in vec4 in_model2;
 
 //Outputs
 out vec3 ex_uv;
-out vec3 ex_normal;
+flat out vec3 ex_normal;
 
 void main(void) {
-	gl_Position = mvp * vec4(in_pos, 1.0);
+	//Rows of the object's local to world matrix. Normals use its cofactor
+	//matrix, the inverse transpose up to a scale that normalize removes.
+	vec4 pos = vec4(in_pos, 1.0);
+	gl_Position = viewProj * vec4(dot(in_model0, pos), dot(in_model1, pos), dot(in_model2, pos), 1.0);
 	ex_uv = in_uv;
-	ex_normal = normalize((mv * vec4(in_normal, 0.0)).xyz);
+	mat3 m = mat3(in_model0.xyz, in_model1.xyz, in_model2.xyz);
+	ex_normal = normalize(in_normal * mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1])));
 }
@@ -9,13 +9,16 @@ public:
     shader = AquireShader("sky");
   }
 
+  //Drawn after everything else, only where the depth is still cleared
   void Draw(const Camera& cam) {
     glDepthMask(GL_FALSE);
-    const Matrix4 mvp = cam.projection.Inverse();
-    const Matrix4 mv = cam.worldView.Inverse();
+    glDepthFunc(GL_LEQUAL);
+    const Matrix4 mvp = cam.InverseProjection();
+    const Matrix4 mv = cam.worldView.InverseOrthogonal().ToMatrix4();
     shader->Use();
     shader->SetMVP(mvp.m, mv.m);
     mesh->Draw();
+    glDepthFunc(GL_LESS);
     glDepthMask(GL_TRUE);
   }
 
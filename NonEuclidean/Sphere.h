@@ -8,13 +8,13 @@ public:
   Sphere(const Vector3& pos, float r) : center(pos), radius(r) {}
 
   //Transformations to and frpom sphere coordinates
-  Matrix4 UnitToLocal() const {
+  Affine3x4 UnitToLocal() const {
     assert(radius > 0.0f);
-    return Matrix4::Trans(center) * Matrix4::Scale(radius);
+    return Affine3x4::Trans(center) * Affine3x4::Scale(radius);
   }
-  Matrix4 LocalToUnit() const {
+  Affine3x4 LocalToUnit() const {
     assert(radius > 0.0f);
-    return Matrix4::Scale(1.0f / radius) * Matrix4::Trans(-center);
+    return Affine3x4::Scale(1.0f / radius) * Affine3x4::Trans(-center);
   }
 
   Vector3 center;
@@ -0,0 +1,196 @@
+#include "StaticGeometry.h"
+#include "GLState.h"
+#include "Mesh.h"
+#include "Particles.h"
+#include "Shader.h"
+#include "Texture.h"
+#include <algorithm>
+#include <map>
+
+StaticGeometry::StaticGeometry() : indirectBuffer(0) {}
+
+StaticGeometry::~StaticGeometry() {
+  Clear();
+}
+
+void StaticGeometry::Build(const PObjectVec& objs, std::vector<uint8_t>& merged) {
+  Clear();
+  merged.assign(objs.size(), 0);
+  if (!GLEW_VERSION_4_3) {
+    return;
+  }
+
+  //Only plain static objects with an instanced shader can go in a batch
+  for (size_t i = 0; i < objs.size(); ++i) {
+    const Object& obj = *objs[i];
+    Mesh* mesh = obj.mesh.get();
+    if (!obj.isStatic || obj.AsParticles() || !mesh || mesh->NumIndices() == 0 ||
+        !obj.shader || !obj.shader->IsInstanced()) {
+      continue;
+    }
+
+    //Find a batch with the same state and vertex format
+    Batch* batch = nullptr;
+    for (size_t j = 0; j < batches.size() && !batch; ++j) {
+      Batch& b = batches[j];
+      if (b.shader == obj.shader.get() && b.texture == obj.texture.get() &&
+          b.uvSize == mesh->UVSize() && b.indexType == mesh->IndexType()) {
+        batch = &b;
+      }
+    }
+    if (!batch) {
+      batches.push_back(Batch());
+      batch = &batches.back();
+      batch->shader = obj.shader.get();
+      batch->texture = obj.texture.get();
+      batch->uvSize = mesh->UVSize();
+      batch->indexType = mesh->IndexType();
+      batch->vao = batch->vbo = batch->ibo = 0;
+      batch->firstCommand = 0;
+      batch->numCommands = 0;
+    }
+
+    Part part;
+    part.obj = &obj;
+    part.mesh = mesh;
+    part.bounds = obj.WorldBounds();
+    part.center = obj.LocalToWorld().Translation();
+    part.count = GLuint(mesh->NumIndices());
+    part.firstIndex = 0;
+    part.baseVertex = 0;
+    batch->parts.push_back(part);
+    merged[i] = 1;
+  }
+
+  glGenBuffers(1, &indirectBuffer);
+  for (size_t i = 0; i < batches.size(); ++i) {
+    Upload(batches[i]);
+  }
+}
+
+void StaticGeometry::Upload(Batch& batch) {
+  //Every mesh goes in once, objects sharing it share its range
+  const size_t vertexSize = (6 + batch.uvSize) * sizeof(float);
+  const size_t indexSize = (batch.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+  std::map<const Mesh*, size_t> placed;
+  std::vector<const Mesh*> meshes;
+  size_t numVerts = 0;
+  size_t numIndices = 0;
+  for (size_t i = 0; i < batch.parts.size(); ++i) {
+    Part& part = batch.parts[i];
+    auto result = placed.insert(std::make_pair(part.mesh, i));
+    if (result.second) {
+      part.baseVertex = GLint(numVerts);
+      part.firstIndex = GLuint(numIndices);
+      numVerts += part.mesh->NumVertices();
+      numIndices += part.mesh->NumIndices();
+      meshes.push_back(part.mesh);
+    } else {
+      const Part& first = batch.parts[result.first->second];
+      part.baseVertex = first.baseVertex;
+      part.firstIndex = first.firstIndex;
+    }
+  }
+
+  //Copy the meshes' buffers on the GPU, nothing was kept on the CPU side
+  glGenBuffers(1, &batch.vbo);
+  glGenBuffers(1, &batch.ibo);
+  const GLuint dst[2] = { batch.vbo, batch.ibo };
+  const size_t elementSize[2] = { vertexSize, indexSize };
+  const size_t total[2] = { numVerts, numIndices };
+  for (int k = 0; k < 2; ++k) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, dst[k]);
+    glBufferData(GL_COPY_WRITE_BUFFER, total[k] * elementSize[k], nullptr, GL_STATIC_DRAW);
+    size_t offset = 0;
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      const size_t bytes = (k == 0 ? meshes[i]->NumVertices() : meshes[i]->NumIndices()) * elementSize[k];
+      glBindBuffer(GL_COPY_READ_BUFFER, (k == 0 ? meshes[i]->VertexBuffer() : meshes[i]->IndexBuffer()));
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, bytes);
+      offset += bytes;
+    }
+  }
+
+  //The transforms are pointed at when drawing, their buffer can be replaced
+  glGenVertexArrays(1, &batch.vao);
+  GLState::BindVertexArray(batch.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, batch.vbo);
+  Mesh::SetVertexAttribs(batch.uvSize);
+  Mesh::SetInstanceAttribs(0, true);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch.ibo);
+}
+
+void StaticGeometry::Clear() {
+  for (size_t i = 0; i < batches.size(); ++i) {
+    glDeleteVertexArrays(1, &batches[i].vao);
+    glDeleteBuffers(1, &batches[i].vbo);
+    glDeleteBuffers(1, &batches[i].ibo);
+  }
+  if (!batches.empty()) {
+    GLState::Invalidate();
+  }
+  batches.clear();
+  if (indirectBuffer) {
+    glDeleteBuffers(1, &indirectBuffer);
+    indirectBuffer = 0;
+  }
+}
+
+void StaticGeometry::Draw(const Camera& cam, const Frustum& frustum, const TransformBuffer& transforms,
+                          int64_t& drawn, int64_t& culled) {
+  if (batches.empty()) {
+    return;
+  }
+
+  //Cull and write the commands, nearest first within each batch
+  commands.clear();
+  for (size_t i = 0; i < batches.size(); ++i) {
+    Batch& batch = batches[i];
+    visible.clear();
+    for (size_t j = 0; j < batch.parts.size(); ++j) {
+      const Part& part = batch.parts[j];
+      if (!frustum.Intersects(part.bounds)) {
+        culled += 1;
+        continue;
+      }
+      const float depth = -cam.worldView.MulPoint(part.center).z;
+      visible.push_back(std::make_pair(depth, uint32_t(j)));
+    }
+    std::sort(visible.begin(), visible.end());
+
+    batch.firstCommand = commands.size();
+    batch.numCommands = GLsizei(visible.size());
+    for (size_t j = 0; j < visible.size(); ++j) {
+      const Part& part = batch.parts[visible[j].second];
+      DrawElementsCommand cmd;
+      cmd.count = part.count;
+      cmd.instanceCount = 1;
+      cmd.firstIndex = part.firstIndex;
+      cmd.baseVertex = part.baseVertex;
+      cmd.baseInstance = part.obj->transform;
+      commands.push_back(cmd);
+    }
+  }
+  drawn += int64_t(commands.size());
+  if (commands.empty()) {
+    return;
+  }
+
+  //All commands go up at once, then each batch is one call
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsCommand), commands.data(), GL_STREAM_DRAW);
+  for (size_t i = 0; i < batches.size(); ++i) {
+    const Batch& batch = batches[i];
+    if (batch.numCommands == 0) {
+      continue;
+    }
+    batch.shader->Use();
+    if (batch.texture) {
+      batch.texture->Use();
+    }
+    GLState::BindVertexArray(batch.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, transforms.Buffer());
+    Mesh::SetInstanceAttribs(0, false);
+    GLState::MultiDrawElementsIndirect(GL_TRIANGLES, batch.indexType,
+      batch.firstCommand * sizeof(DrawElementsCommand), batch.numCommands);
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "Camera.h"
+#include "GLState.h"
+#include "Object.h"
+#include "TransformBuffer.h"
+#include <GL/glew.h>
+#include <vector>
+
+//Forward declarations
+class Mesh;
+class Shader;
+class Texture;
+
+//Static objects merged when a scene loads. Objects that share a shader,
+//texture and vertex format get one vertex and index buffer between them.
+//Each view culls them on the CPU, writes an indirect draw per visible object
+//and submits every batch with a single multi-draw. The base instance of each
+//draw picks the object's transform in this frame's TransformBuffer. Needs
+//GL 4.3, without it nothing is merged and the objects go through the render
+//queue instead.
+class StaticGeometry {
+public:
+  StaticGeometry();
+  ~StaticGeometry();
+
+  //Merges what it can, flagging the objects it will draw from now on
+  void Build(const PObjectVec& objs, std::vector<uint8_t>& merged);
+  void Clear();
+
+  //Draws the merged objects inside the frustum with the current camera and
+  //counts the rest as culled
+  void Draw(const Camera& cam, const Frustum& frustum, const TransformBuffer& transforms,
+            int64_t& drawn, int64_t& culled);
+
+  size_t NumBatches() const { return batches.size(); }
+
+private:
+  StaticGeometry(const StaticGeometry&) = delete;
+  StaticGeometry& operator=(const StaticGeometry&) = delete;
+
+  //One object and where its mesh landed in the merged buffers
+  struct Part {
+    const Object* obj;
+    Mesh* mesh;
+    AABB bounds;
+    Vector3 center;
+    GLuint count;
+    GLuint firstIndex;
+    GLint baseVertex;
+  };
+
+  struct Batch {
+    Shader* shader;
+    Texture* texture;
+    int uvSize;
+    GLenum indexType;
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
+    std::vector<Part> parts;
+    size_t firstCommand;  // visible parts this view
+    GLsizei numCommands;
+  };
+
+  void Upload(Batch& batch);
+
+  std::vector<Batch> batches;
+
+  //Rebuilt every view and uploaded in one go for all batches
+  std::vector<DrawElementsCommand> commands;
+  std::vector<std::pair<float, uint32_t>> visible;
+  GLuint indirectBuffer;
+};
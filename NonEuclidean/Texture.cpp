@@ -1,15 +1,20 @@
 #include "Texture.h"
+#include "GameHeader.h"
+#include "GLState.h"
+#include "Profiler.h"
 #include <fstream>
 #include <cassert>
 
 Texture::Texture(const char* fname, int rows, int cols) {
+  ProfileZone zone("Load texture");
+
   //Check if this is a 3D texture
   assert(rows >= 1 && cols >= 1);
   is3D = (rows > 1 || cols > 1);
 
   //Open the bitmap
   std::ifstream fin(std::string("Textures/") + fname, std::ios::in | std::ios::binary);
-  if (!fin) {
+  if (!fin || !GH_HAS_GL) {
     texId = 0;
     return;
   }
@@ -43,7 +48,7 @@ Texture::Texture(const char* fname, int rows, int cols) {
   //Load texture into video memory
   glGenTextures(1, &texId);
   if (is3D) {
-    glBindTexture(GL_TEXTURE_2D_ARRAY, texId);
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, texId);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -52,7 +57,7 @@ Texture::Texture(const char* fname, int rows, int cols) {
     glGenerateMipmap(GL_TEXTURE_2D);
     glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, width/rows, height/cols, rows*cols, 0, GL_BGR, GL_UNSIGNED_BYTE, img);
   } else {
-    glBindTexture(GL_TEXTURE_2D, texId);
+    GLState::BindTexture(GL_TEXTURE_2D, texId);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -66,8 +71,8 @@ Texture::Texture(const char* fname, int rows, int cols) {
 
 void Texture::Use() {
   if (is3D) {
-    glBindTexture(GL_TEXTURE_2D_ARRAY, texId);
+    GLState::BindTexture(GL_TEXTURE_2D_ARRAY, texId);
   } else {
-    glBindTexture(GL_TEXTURE_2D, texId);
+    GLState::BindTexture(GL_TEXTURE_2D, texId);
   }
 }
\ No newline at end of file
@@ -1,28 +1,33 @@
 #pragma once
+#include <stdint.h>
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#include <time.h>
+#endif
 
 class Timer {
 public:
   Timer() {
-    QueryPerformanceFrequency(&frequency);
+    frequency = QueryFrequency();
   }
 
   void Start() {
-    QueryPerformanceCounter(&t1);
+    t1 = QueryTicks();
   }
 
   float Stop() {
-    QueryPerformanceCounter(&t2);
-    return float(t2.QuadPart - t1.QuadPart) / frequency.QuadPart;
+    t2 = QueryTicks();
+    return float(t2 - t1) / frequency;
   }
 
   int64_t GetTicks() {
-    QueryPerformanceCounter(&t2);
-    return t2.QuadPart;
+    t2 = QueryTicks();
+    return t2;
   }
 
   int64_t SecondsToTicks(float s) {
-    return int64_t(float(frequency.QuadPart) * s);
+    return int64_t(float(frequency) * s);
   }
 
   float StopStart() {
@@ -31,7 +36,30 @@ public:
     return result;
   }
 
+  //Raw clock, safe to call from any thread
+#ifdef _WIN32
+  static int64_t QueryFrequency() {
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    return f.QuadPart;
+  }
+  static int64_t QueryTicks() {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+  }
+#else
+  static int64_t QueryFrequency() {
+    return 1000000000;
+  }
+  static int64_t QueryTicks() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+  }
+#endif
+
 private:
-  LARGE_INTEGER frequency;        // ticks per second
-  LARGE_INTEGER t1, t2;           // ticks
+  int64_t frequency;        // ticks per second
+  int64_t t1, t2;           // ticks
 };
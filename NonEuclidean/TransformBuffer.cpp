@@ -0,0 +1,156 @@
+#include "TransformBuffer.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <cassert>
+
+static const size_t FLOATS_PER_TRANSFORM = Mesh::INSTANCE_STRIDE / sizeof(float);
+static const size_t CAMERA_BYTES = 16 * sizeof(float);
+
+TransformBuffer::TransformBuffer() : buffer(0), persistent(false), mapped(nullptr),
+  changed(true), capacity(0), count(0), frame(0), cameraRing(0), cameraMapped(nullptr), cameraStride(CAMERA_BYTES),
+  cameraCapacity(0), numCameras(0), maxCameras(0), cameraBuffer(0) {
+  for (int i = 0; i < GH_FRAMES_IN_FLIGHT; ++i) {
+    fences[i] = 0;
+  }
+}
+
+TransformBuffer::~TransformBuffer() {
+  Release();
+}
+
+void TransformBuffer::Create(size_t newCapacity, size_t newCameraCapacity) {
+  //Draws may still be using the old buffers, GL frees them once they're done
+  for (int i = 0; i < GH_FRAMES_IN_FLIGHT; ++i) {
+    if (fences[i]) {
+      glDeleteSync(fences[i]);
+      fences[i] = 0;
+    }
+  }
+  if (buffer) {
+    glDeleteBuffers(1, &buffer);
+  }
+  if (cameraRing) {
+    glDeleteBuffers(1, &cameraRing);
+    cameraRing = 0;
+  }
+  capacity = newCapacity;
+  cameraCapacity = newCameraCapacity;
+  frame = 0;
+
+  const size_t frameBytes = capacity * FLOATS_PER_TRANSFORM * sizeof(float);
+  persistent = (GLEW_VERSION_4_4 != 0);
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  if (persistent) {
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, frameBytes * GH_FRAMES_IN_FLIGHT, nullptr, flags);
+    mapped = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0, frameBytes * GH_FRAMES_IN_FLIGHT, flags);
+
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    cameraStride = (CAMERA_BYTES + alignment - 1) / alignment * alignment;
+    const size_t cameraBytes = cameraStride * cameraCapacity * GH_FRAMES_IN_FLIGHT;
+    glGenBuffers(1, &cameraRing);
+    glBindBuffer(GL_UNIFORM_BUFFER, cameraRing);
+    glBufferStorage(GL_UNIFORM_BUFFER, cameraBytes, nullptr, flags);
+    cameraMapped = (char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, cameraBytes, flags);
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, frameBytes, nullptr, GL_STREAM_DRAW);
+    mapped = nullptr;
+    cameraMapped = nullptr;
+    cameraCapacity = 0;
+    staging.resize(capacity * FLOATS_PER_TRANSFORM);
+  }
+}
+
+void TransformBuffer::BeginFrame(size_t _count) {
+  if (_count > capacity || (persistent && maxCameras > cameraCapacity)) {
+    Create(GH_MAX(_count, GH_MAX(capacity * 2, size_t(64))), GH_MAX(maxCameras * 2, size_t(64)));
+  } else if (fences[frame]) {
+    //Only waits if the GPU is still on the frame that last used this part
+    while (glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+    glDeleteSync(fences[frame]);
+    fences[frame] = 0;
+  }
+  count = 0;
+  numCameras = 0;
+  changed = (_count * FLOATS_PER_TRANSFORM != previous.size());
+  previous.resize(_count * FLOATS_PER_TRANSFORM);
+}
+
+uint32_t TransformBuffer::Add(const Affine3x4& localToWorld) {
+  assert(count < capacity);
+  const size_t slot = (persistent ? frame * capacity : 0) + count;
+  float* dst = (persistent ? mapped + slot * FLOATS_PER_TRANSFORM : &staging[count * FLOATS_PER_TRANSFORM]);
+  std::copy(localToWorld.m, localToWorld.m + 12, dst);
+  float* prev = &previous[count * FLOATS_PER_TRANSFORM];
+  if (!std::equal(localToWorld.m, localToWorld.m + 12, prev)) {
+    std::copy(localToWorld.m, localToWorld.m + 12, prev);
+    changed = true;
+  }
+  count += 1;
+  return uint32_t(slot);
+}
+
+void TransformBuffer::Commit() {
+  //Coherent mappings are seen by the GPU without doing anything
+  if (!persistent && count > 0) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, staging.size() * sizeof(float), staging.data(), GL_STREAM_DRAW);
+  }
+}
+
+void TransformBuffer::EndFrame() {
+  if (persistent) {
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame = (frame + 1) % GH_FRAMES_IN_FLIGHT;
+  }
+  maxCameras = GH_MAX(maxCameras, numCameras);
+}
+
+void TransformBuffer::UseCamera(const Camera& cam) {
+  //std140 wants column major
+  const Matrix4 viewProj = cam.Matrix().Transposed();
+  if (numCameras < cameraCapacity) {
+    const size_t offset = (frame * cameraCapacity + numCameras) * cameraStride;
+    std::copy(viewProj.m, viewProj.m + 16, (float*)(cameraMapped + offset));
+    glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_BLOCK, cameraRing, offset, CAMERA_BYTES);
+  } else {
+    if (!cameraBuffer) {
+      glGenBuffers(1, &cameraBuffer);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, CAMERA_BYTES, viewProj.m, GL_STREAM_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK, cameraBuffer);
+  }
+  numCameras += 1;
+}
+
+void TransformBuffer::Release() {
+  for (int i = 0; i < GH_FRAMES_IN_FLIGHT; ++i) {
+    if (fences[i]) {
+      glDeleteSync(fences[i]);
+      fences[i] = 0;
+    }
+  }
+  if (buffer) {
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+  }
+  if (cameraRing) {
+    glDeleteBuffers(1, &cameraRing);
+    cameraRing = 0;
+  }
+  if (cameraBuffer) {
+    glDeleteBuffers(1, &cameraBuffer);
+    cameraBuffer = 0;
+  }
+  mapped = nullptr;
+  cameraMapped = nullptr;
+  staging.clear();
+  previous.clear();
+  changed = true;
+  capacity = count = 0;
+  cameraCapacity = numCameras = maxCameras = 0;
+  frame = 0;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "Camera.h"
+#include "GameHeader.h"
+#include "Vector.h"
+#include <GL/glew.h>
+#include <vector>
+
+//Everything the object shaders need that isn't per vertex. Object transforms
+//are written once per frame in the layout of Mesh's instance attributes, so a
+//draw only points them at its first transform. Each view's camera goes in a
+//uniform block. With GL 4.4 both live in persistently mapped rings of
+//GH_FRAMES_IN_FLIGHT frames and writing them never waits on the GPU,
+//otherwise the buffers are filled again each frame or view.
+class TransformBuffer {
+public:
+  static const GLuint CAMERA_BLOCK = 0;
+
+  TransformBuffer();
+  ~TransformBuffer();
+
+  //Starts a frame with room for count transforms, then Add them and Commit
+  //before anything is drawn. EndFrame goes after the frame's last draw.
+  void BeginFrame(size_t count);
+  uint32_t Add(const Affine3x4& localToWorld);
+  void Commit();
+  void EndFrame();
+
+  //Whether any transform differs from last frame's, scene loads count too
+  bool Changed() const { return changed; }
+
+  //Holds this frame's transforms, Add's result times Mesh::INSTANCE_STRIDE
+  //is the offset of one
+  GLuint Buffer() const { return buffer; }
+  //A transform on the CPU side, only kept when the buffer isn't persistent
+  const float* Staged(uint32_t slot) const { return persistent ? nullptr : &staging[slot * 12]; }
+
+  //Sets the camera for the draws that follow, once per view
+  void UseCamera(const Camera& cam);
+
+  void Release();
+
+private:
+  TransformBuffer(const TransformBuffer&) = delete;
+  TransformBuffer& operator=(const TransformBuffer&) = delete;
+
+  void Create(size_t newCapacity, size_t newCameraCapacity);
+
+  GLuint buffer;
+  bool persistent;
+  float* mapped;               // the whole ring while persistently mapped
+  std::vector<float> staging;  // this frame's transforms otherwise
+  std::vector<float> previous; // last frame's, to tell if anything moved
+  bool changed;
+  size_t capacity;             // transforms per frame
+  size_t count;
+  int frame;                   // part of the rings being written
+  GLsync fences[GH_FRAMES_IN_FLIGHT];
+
+  //Camera blocks are padded to the uniform buffer offset alignment. Views past
+  //the ring's capacity go through a buffer filled again for each of them,
+  //and the ring grows next frame.
+  GLuint cameraRing;
+  char* cameraMapped;
+  size_t cameraStride;
+  size_t cameraCapacity;       // views per frame
+  size_t numCameras;
+  size_t maxCameras;           // most views seen in a frame
+  GLuint cameraBuffer;
+};
@@ -5,6 +5,14 @@
 #include <iostream>
 #include <cassert>
 
+//SSE kernels are used whenever the target guarantees them
+#if !defined(GH_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define GH_USE_SSE 1
+#include <xmmintrin.h>
+#else
+#define GH_USE_SSE 0
+#endif
+
 class Vector3 {
 public:
   //Constructors
@@ -148,6 +156,12 @@ public:
   inline Vector3 XYZNormalized() const { return Vector3(x, y, z).Normalized(); }
   inline Vector3 Homogenized() const { return Vector3(x/w, y/w, z/w); }
 
+  inline Vector4 operator+(const Vector4& b) const {
+    return Vector4(x + b.x, y + b.y, z + b.z, w + b.w);
+  }
+  inline Vector4 operator-(const Vector4& b) const {
+    return Vector4(x - b.x, y - b.y, z - b.z, w - b.w);
+  }
   inline Vector4 operator*(float b) const {
     return Vector4(x * b, y * b, z * b, w * b);
   }
@@ -273,6 +287,23 @@ public:
 
   //Transformations
   inline Matrix4 Transposed() const {
+#if GH_USE_SSE
+    __m128 r0 = _mm_loadu_ps(m);
+    __m128 r1 = _mm_loadu_ps(m + 4);
+    __m128 r2 = _mm_loadu_ps(m + 8);
+    __m128 r3 = _mm_loadu_ps(m + 12);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    Matrix4 out;
+    _mm_storeu_ps(out.m, r0);
+    _mm_storeu_ps(out.m + 4, r1);
+    _mm_storeu_ps(out.m + 8, r2);
+    _mm_storeu_ps(out.m + 12, r3);
+    return out;
+#else
+    return TransposedScalar();
+#endif
+  }
+  inline Matrix4 TransposedScalar() const {
     Matrix4 out;
     out.m[0]  = m[0]; out.m[1]  = m[4]; out.m[2]  = m[8];  out.m[3]  = m[12];
     out.m[4]  = m[1]; out.m[5]  = m[5]; out.m[6]  = m[9];  out.m[7]  = m[13];
@@ -316,7 +347,11 @@ public:
   }
 
   //Multiplication
+  //SSE was measured slower than this for a single 4x4 product
   Matrix4 operator*(const Matrix4& b) const {
+    return MulScalar(b);
+  }
+  Matrix4 MulScalar(const Matrix4& b) const {
     Matrix4 out;
     out.m[0]  = b.m[0]*m[0]  + b.m[4]*m[1]  + b.m[8] *m[2]  + b.m[12]*m[3];
     out.m[1]  = b.m[1]*m[0]  + b.m[5]*m[1]  + b.m[9] *m[2]  + b.m[13]*m[3];
@@ -367,8 +402,59 @@ public:
     );
   }
 
+  //Batch transforms, in and out may be the same array
+  void MulPoints(const Vector3* in, Vector3* out, size_t n) const {
+#if GH_USE_SSE
+    __m128 c0 = _mm_loadu_ps(m);
+    __m128 c1 = _mm_loadu_ps(m + 4);
+    __m128 c2 = _mm_loadu_ps(m + 8);
+    __m128 c3 = _mm_loadu_ps(m + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    for (size_t i = 0; i < n; ++i) {
+      __m128 r = _mm_mul_ps(c0, _mm_set1_ps(in[i].x));
+      r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(in[i].y)));
+      r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(in[i].z)));
+      r = _mm_add_ps(r, c3);
+      r = _mm_div_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+      StoreXYZ(r, out[i]);
+    }
+#else
+    MulPointsScalar(in, out, n);
+#endif
+  }
+  void MulDirections(const Vector3* in, Vector3* out, size_t n) const {
+#if GH_USE_SSE
+    __m128 c0 = _mm_loadu_ps(m);
+    __m128 c1 = _mm_loadu_ps(m + 4);
+    __m128 c2 = _mm_loadu_ps(m + 8);
+    __m128 c3 = _mm_loadu_ps(m + 12);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    for (size_t i = 0; i < n; ++i) {
+      __m128 r = _mm_mul_ps(c0, _mm_set1_ps(in[i].x));
+      r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(in[i].y)));
+      r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(in[i].z)));
+      StoreXYZ(r, out[i]);
+    }
+#else
+    MulDirectionsScalar(in, out, n);
+#endif
+  }
+  void MulPointsScalar(const Vector3* in, Vector3* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) { out[i] = MulPoint(in[i]); }
+  }
+  void MulDirectionsScalar(const Vector3* in, Vector3* out, size_t n) const {
+    for (size_t i = 0; i < n; ++i) { out[i] = MulDirection(in[i]); }
+  }
+
   //Inverse
   Matrix4 Inverse() const {
+#if GH_USE_SSE
+    return InverseSSE();
+#else
+    return InverseScalar();
+#endif
+  }
+  Matrix4 InverseScalar() const {
     Matrix4 inv;
 
     inv.m[0] = m[5] * m[10] * m[15] -
@@ -488,10 +574,271 @@ public:
     return inv;
   }
 
+#if GH_USE_SSE
+  //Block-wise inverse using 2x2 sub-matrices A B / C D, each packed in one register
+  Matrix4 InverseSSE() const {
+    const __m128 r0 = _mm_loadu_ps(m);
+    const __m128 r1 = _mm_loadu_ps(m + 4);
+    const __m128 r2 = _mm_loadu_ps(m + 8);
+    const __m128 r3 = _mm_loadu_ps(m + 12);
+    const __m128 A = _mm_movelh_ps(r0, r1);
+    const __m128 B = _mm_movehl_ps(r1, r0);
+    const __m128 C = _mm_movelh_ps(r2, r3);
+    const __m128 D = _mm_movehl_ps(r3, r2);
+
+    //Determinants of the sub-matrices (|A| |B| |C| |D|)
+    const __m128 detSub = _mm_sub_ps(
+      _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(3, 1, 3, 1))),
+      _mm_mul_ps(_mm_shuffle_ps(r0, r2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(r1, r3, _MM_SHUFFLE(2, 0, 2, 0))));
+    const __m128 detA = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(0, 0, 0, 0));
+    const __m128 detB = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(1, 1, 1, 1));
+    const __m128 detC = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(2, 2, 2, 2));
+    const __m128 detD = _mm_shuffle_ps(detSub, detSub, _MM_SHUFFLE(3, 3, 3, 3));
+
+    //Adjugate products and the (unscaled) blocks of the inverse
+    const __m128 D_C = Mat2AdjMul(D, C);
+    const __m128 A_B = Mat2AdjMul(A, B);
+    __m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2Mul(B, D_C));
+    __m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2Mul(C, A_B));
+    __m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2MulAdj(D, A_B));
+    __m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2MulAdj(A, D_C));
+
+    //|M| = |A||D| + |B||C| - tr((A#B)(D#C))
+    __m128 tr = _mm_mul_ps(A_B, _mm_shuffle_ps(D_C, D_C, _MM_SHUFFLE(3, 1, 2, 0)));
+    tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(2, 3, 0, 1)));
+    tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, _MM_SHUFFLE(1, 0, 3, 2)));
+    __m128 detM = _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC));
+    detM = _mm_sub_ps(detM, tr);
+
+    const __m128 rDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+    X_ = _mm_mul_ps(X_, rDetM);
+    Y_ = _mm_mul_ps(Y_, rDetM);
+    Z_ = _mm_mul_ps(Z_, rDetM);
+    W_ = _mm_mul_ps(W_, rDetM);
+
+    //Apply the final adjugate while storing rows
+    Matrix4 inv;
+    _mm_storeu_ps(inv.m,      _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(inv.m + 4,  _mm_shuffle_ps(X_, Y_, _MM_SHUFFLE(0, 2, 0, 2)));
+    _mm_storeu_ps(inv.m + 8,  _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(1, 3, 1, 3)));
+    _mm_storeu_ps(inv.m + 12, _mm_shuffle_ps(Z_, W_, _MM_SHUFFLE(0, 2, 0, 2)));
+    return inv;
+  }
+#endif
+
   //Components
   float m[16];
+
+private:
+#if GH_USE_SSE
+  //2x2 row-major helpers: A*B, adj(A)*B and A*adj(B)
+  static inline __m128 Mat2Mul(__m128 a, __m128 b) {
+    return _mm_add_ps(
+      _mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+  }
+  static inline __m128 Mat2AdjMul(__m128 a, __m128 b) {
+    return _mm_sub_ps(
+      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+  }
+  static inline __m128 Mat2MulAdj(__m128 a, __m128 b) {
+    return _mm_sub_ps(
+      _mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+      _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+  }
+  static inline void StoreXYZ(__m128 r, Vector3& out) {
+    _mm_storel_pi(reinterpret_cast<__m64*>(&out.x), r);
+    _mm_store_ss(&out.z, _mm_movehl_ps(r, r));
+  }
+#endif
 };
 
+//Affine transformation stored as the top 3 rows of a Matrix4, the last row is implicitly 0 0 0 1
+class Affine3x4 {
+public:
+  //Constructors
+  Affine3x4() {}
+  explicit Affine3x4(const Matrix4& b) { std::copy(b.m, b.m + 12, m); }
+
+  //General
+  inline void MakeIdentity() {
+    m[0] = 1.0f; m[1] = 0.0f; m[2]  = 0.0f; m[3]  = 0.0f;
+    m[4] = 0.0f; m[5] = 1.0f; m[6]  = 0.0f; m[7]  = 0.0f;
+    m[8] = 0.0f; m[9] = 0.0f; m[10] = 1.0f; m[11] = 0.0f;
+  }
+  inline void MakeRotX(float a) {
+    m[0] = 1.0f; m[1] = 0.0f;        m[2]  = 0.0f;         m[3]  = 0.0f;
+    m[4] = 0.0f; m[5] = std::cos(a); m[6]  = -std::sin(a); m[7]  = 0.0f;
+    m[8] = 0.0f; m[9] = std::sin(a); m[10] = std::cos(a);  m[11] = 0.0f;
+  }
+  inline void MakeRotY(float a) {
+    m[0] = std::cos(a);  m[1] = 0.0f; m[2]  = std::sin(a); m[3]  = 0.0f;
+    m[4] = 0.0f;         m[5] = 1.0f; m[6]  = 0.0f;        m[7]  = 0.0f;
+    m[8] = -std::sin(a); m[9] = 0.0f; m[10] = std::cos(a); m[11] = 0.0f;
+  }
+  inline void MakeRotZ(float a) {
+    m[0] = std::cos(a); m[1] = -std::sin(a); m[2]  = 0.0f; m[3]  = 0.0f;
+    m[4] = std::sin(a); m[5] = std::cos(a);  m[6]  = 0.0f; m[7]  = 0.0f;
+    m[8] = 0.0f;        m[9] = 0.0f;         m[10] = 1.0f; m[11] = 0.0f;
+  }
+  inline void MakeTrans(const Vector3& t) {
+    m[0] = 1.0f; m[1] = 0.0f; m[2]  = 0.0f; m[3]  = t.x;
+    m[4] = 0.0f; m[5] = 1.0f; m[6]  = 0.0f; m[7]  = t.y;
+    m[8] = 0.0f; m[9] = 0.0f; m[10] = 1.0f; m[11] = t.z;
+  }
+  inline void MakeScale(const Vector3& s) {
+    m[0] = s.x;  m[1] = 0.0f; m[2]  = 0.0f; m[3]  = 0.0f;
+    m[4] = 0.0f; m[5] = s.y;  m[6]  = 0.0f; m[7]  = 0.0f;
+    m[8] = 0.0f; m[9] = 0.0f; m[10] = s.z;  m[11] = 0.0f;
+  }
+
+  //Statics
+  inline static Affine3x4 Identity() { Affine3x4 m; m.MakeIdentity(); return m; }
+  inline static Affine3x4 RotX(float a) { Affine3x4 m; m.MakeRotX(a); return m; }
+  inline static Affine3x4 RotY(float a) { Affine3x4 m; m.MakeRotY(a); return m; }
+  inline static Affine3x4 RotZ(float a) { Affine3x4 m; m.MakeRotZ(a); return m; }
+  inline static Affine3x4 Trans(const Vector3& t) { Affine3x4 m; m.MakeTrans(t); return m; }
+  inline static Affine3x4 Scale(float s) { Affine3x4 m; m.MakeScale(Vector3(s)); return m; }
+  inline static Affine3x4 Scale(const Vector3& s) { Affine3x4 m; m.MakeScale(s); return m; }
+
+  //Some getters
+  inline Vector3 XAxis() const {
+    return Vector3(m[0], m[4], m[8]);
+  }
+  inline Vector3 YAxis() const {
+    return Vector3(m[1], m[5], m[9]);
+  }
+  inline Vector3 ZAxis() const {
+    return Vector3(m[2], m[6], m[10]);
+  }
+  inline Vector3 Translation() const {
+    return Vector3(m[3], m[7], m[11]);
+  }
+  inline Matrix4 ToMatrix4() const {
+    Matrix4 out;
+    std::copy(m, m + 12, out.m);
+    out.m[12] = 0.0f; out.m[13] = 0.0f; out.m[14] = 0.0f; out.m[15] = 1.0f;
+    return out;
+  }
+
+  //Setters
+  inline void SetTranslation(const Vector3& t) {
+    m[3] = t.x;
+    m[7] = t.y;
+    m[11] = t.z;
+  }
+  inline void SetXAxis(const Vector3& t) {
+    m[0] = t.x;
+    m[4] = t.y;
+    m[8] = t.z;
+  }
+  inline void SetYAxis(const Vector3& t) {
+    m[1] = t.x;
+    m[5] = t.y;
+    m[9] = t.z;
+  }
+  inline void SetZAxis(const Vector3& t) {
+    m[2] = t.x;
+    m[6] = t.y;
+    m[10] = t.z;
+  }
+
+  //Multiplication
+  Affine3x4 operator*(const Affine3x4& b) const {
+    Affine3x4 out;
+#if GH_USE_SSE
+    //Each output row blends b's rows, the translation lane also picks up our own
+    const __m128 b0 = _mm_loadu_ps(b.m);
+    const __m128 b1 = _mm_loadu_ps(b.m + 4);
+    const __m128 b2 = _mm_loadu_ps(b.m + 8);
+    const __m128 w = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    for (int i = 0; i < 12; i += 4) {
+      const __m128 a = _mm_loadu_ps(m + i);
+      __m128 r = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+      r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+      r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+      r = _mm_add_ps(r, _mm_mul_ps(a, w));
+      _mm_storeu_ps(out.m + i, r);
+    }
+#else
+    for (int i = 0; i < 12; i += 4) {
+      out.m[i]     = m[i]*b.m[0] + m[i + 1]*b.m[4] + m[i + 2]*b.m[8];
+      out.m[i + 1] = m[i]*b.m[1] + m[i + 1]*b.m[5] + m[i + 2]*b.m[9];
+      out.m[i + 2] = m[i]*b.m[2] + m[i + 1]*b.m[6] + m[i + 2]*b.m[10];
+      out.m[i + 3] = m[i]*b.m[3] + m[i + 1]*b.m[7] + m[i + 2]*b.m[11] + m[i + 3];
+    }
+#endif
+    return out;
+  }
+  void operator*=(const Affine3x4& b) {
+    (*this) = operator*(b);
+  }
+  Vector3 MulPoint(const Vector3& b) const {
+    return Vector3(
+      m[0] * b.x + m[1] * b.y + m[2] * b.z + m[3],
+      m[4] * b.x + m[5] * b.y + m[6] * b.z + m[7],
+      m[8] * b.x + m[9] * b.y + m[10] * b.z + m[11]
+    );
+  }
+  Vector3 MulDirection(const Vector3& b) const {
+    return Vector3(
+      m[0] * b.x + m[1] * b.y + m[2] * b.z,
+      m[4] * b.x + m[5] * b.y + m[6] * b.z,
+      m[8] * b.x + m[9] * b.y + m[10] * b.z
+    );
+  }
+
+  //General affine inverse, only the 3x3 part needs cofactors
+  Affine3x4 Inverse() const {
+    Affine3x4 inv;
+    inv.m[0] = m[5] * m[10] - m[6] * m[9];
+    inv.m[1] = m[2] * m[9] - m[1] * m[10];
+    inv.m[2] = m[1] * m[6] - m[2] * m[5];
+    inv.m[4] = m[6] * m[8] - m[4] * m[10];
+    inv.m[5] = m[0] * m[10] - m[2] * m[8];
+    inv.m[6] = m[2] * m[4] - m[0] * m[6];
+    inv.m[8] = m[4] * m[9] - m[5] * m[8];
+    inv.m[9] = m[1] * m[8] - m[0] * m[9];
+    inv.m[10] = m[0] * m[5] - m[1] * m[4];
+    const float invDet = 1.0f / (m[0] * inv.m[0] + m[1] * inv.m[4] + m[2] * inv.m[8]);
+    for (int i = 0; i < 12; i += 4) {
+      inv.m[i] *= invDet; inv.m[i + 1] *= invDet; inv.m[i + 2] *= invDet;
+    }
+    inv.SetTranslation(-inv.MulDirection(Translation()));
+    return inv;
+  }
+
+  //Inverse for rigid, TRS and similarity transforms (mutually orthogonal axes),
+  //each row of the inverse is an axis divided by its squared length
+  Affine3x4 InverseOrthogonal() const {
+    const Vector3 x = XAxis() * (1.0f / XAxis().MagSq());
+    const Vector3 y = YAxis() * (1.0f / YAxis().MagSq());
+    const Vector3 z = ZAxis() * (1.0f / ZAxis().MagSq());
+    Affine3x4 inv;
+    inv.m[0] = x.x; inv.m[1] = x.y; inv.m[2]  = x.z;
+    inv.m[4] = y.x; inv.m[5] = y.y; inv.m[6]  = y.z;
+    inv.m[8] = z.x; inv.m[9] = z.y; inv.m[10] = z.z;
+    inv.SetTranslation(-inv.MulDirection(Translation()));
+    return inv;
+  }
+
+  //Components
+  float m[12];
+};
+
+//General 4x4 times affine, skips the implicit last row
+inline Matrix4 operator*(const Matrix4& a, const Affine3x4& b) {
+  Matrix4 out;
+  for (int i = 0; i < 16; i += 4) {
+    out.m[i]     = a.m[i]*b.m[0] + a.m[i + 1]*b.m[4] + a.m[i + 2]*b.m[8];
+    out.m[i + 1] = a.m[i]*b.m[1] + a.m[i + 1]*b.m[5] + a.m[i + 2]*b.m[9];
+    out.m[i + 2] = a.m[i]*b.m[2] + a.m[i + 1]*b.m[6] + a.m[i + 2]*b.m[10];
+    out.m[i + 3] = a.m[i]*b.m[3] + a.m[i + 1]*b.m[7] + a.m[i + 2]*b.m[11] + a.m[i + 3];
+  }
+  return out;
+}
+
 //Debug printing
 inline std::ostream& operator<<(std::ostream& out, const Vector3& v) {
   out << v.x << ", " << v.y << ", " << v.z;
@@ -508,3 +855,9 @@ inline std::ostream& operator<<(std::ostream& out, const Matrix4& m) {
   out << m.m[12] << ", " << m.m[13] << ", " << m.m[14] << ", " << m.m[15];
   return out;
 }
+inline std::ostream& operator<<(std::ostream& out, const Affine3x4& m) {
+  out << m.m[0] << ", " << m.m[1] << ", " << m.m[2]  << ", " << m.m[3] << "\n";
+  out << m.m[4] << ", " << m.m[5] << ", " << m.m[6]  << ", " << m.m[7] << "\n";
+  out << m.m[8] << ", " << m.m[9] << ", " << m.m[10] << ", " << m.m[11];
+  return out;
+}